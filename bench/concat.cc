@@ -0,0 +1,73 @@
+// Constant folding time of long `+` chains of string literals, both all
+// constant and with a variable breaking the chain up.
+//
+//   make bench CFLAGS="-std=c++11 -O2 -c" BUILD_DIR=build/release
+//   build/release/bench/concat [terms]
+
+#include "src/compiler.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+
+// one statement concatenating terms string literals, every mixed
+// chain has a variable after each 64 literals
+static std::string generate_chain(std::size_t terms, bool mixed) {
+    std::string code = "let s = \"start\"";
+    for (std::size_t i = 0; i < terms; i++) {
+        if (mixed && i % 64 == 63)
+            code += " + x";
+        code += sformat(" + \"piece %lu of the chain\"", i);
+    }
+    return code + "\n";
+}
+
+// time one call in seconds
+static double timed(const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+#define keep_best(best, value) do {                          \
+        const double seconds = (value);                         \
+        if (run == 0 || seconds < (best)) (best) = seconds;     \
+    } while (0)
+
+static void measure(std::size_t terms, bool mixed) {
+    Source source;
+    source.assign("chain.rath", generate_chain(terms, mixed));
+
+    double tree_best = 0, flat_best = 0;
+    std::size_t folded = 0;
+    for (int run = 0; run < 5; run++) {
+        Compiler compiler;
+        ExprPtr tree = compiler.parse(source);
+        const std::size_t before = compiler.arena_used();
+        keep_best(tree_best, timed([&] { tree = compiler.optimize(tree); }));
+        folded = compiler.arena_used() - before;
+
+        FlatAst flat;
+        flat.build(compiler.parse(source));
+        keep_best(flat_best, timed([&] { compiler.optimize(flat); }));
+    }
+
+    std::printf("%s chain of %lu: tree fold %.4fs (%lu node bytes), flat fold %.4fs\n",
+        mixed ? "mixed" : "constant", terms, tree_best, folded, flat_best);
+}
+
+int main(int argc, char** argv) {
+    const std::size_t terms = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+    try {
+        for (std::size_t n = terms / 4; n <= terms; n *= 2) {
+            measure(n, false);
+            measure(n, true);
+        }
+    } catch (const std::exception& err) {
+        std::fprintf(stderr, "%s\n", err.what());
+        return 1;
+    }
+    return 0;
+}
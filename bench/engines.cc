@@ -0,0 +1,113 @@
+// Run time of the tree walking interpreter versus the bytecode vm on
+// arithmetic, call and switch heavy programs.
+//
+//   make bench CFLAGS="-std=c++11 -O2 -c" BUILD_DIR=build/release
+//   build/release/bench/engines [scale]
+
+#include "src/compiler.hh"
+
+#include <chrono>
+#include <cstdlib>
+
+// integer kernel at the leaves of a divide and conquer sum
+static const char* arith_program =
+    "func term(i) -> {\n"
+    "  let a = i * 31 + 7\n"
+    "  let b = (a ^ (a >> 3)) & 65535\n"
+    "  let c = b * b - a * 3 + (i % 13)\n"
+    "  return (c + b - a) & 1048575\n"
+    "}\n"
+    "func sum(lo, hi) -> {\n"
+    "  if hi - lo <= 4 then return term(lo) + term(lo + 1) + term(lo + 2) + term(lo + 3)\n"
+    "  let mid = lo + (hi - lo) / 2\n"
+    "  return sum(lo, mid) + sum(mid, hi)\n"
+    "}\n"
+    "sum(0, SCALE * 8192)\n";
+
+// nothing but calls and small compares
+static const char* call_program =
+    "func fib(n) -> {\n"
+    "  if n < 2 then return n\n"
+    "  return fib(n - 1) + fib(n - 2)\n"
+    "}\n"
+    "let total = 0\n"
+    "func repeat(k) -> {\n"
+    "  if k == 0 then return 0\n"
+    "  total := total + fib(20)\n"
+    "  return repeat(k - 1)\n"
+    "}\n"
+    "repeat(SCALE * 4)\n"
+    "total\n";
+
+// a dispatch over many cases per value
+static const char* switch_program =
+    "func classify(n) -> switch n % 16 -> {\n"
+    "  case 0 -> 1\n"
+    "  case 1 case 2 -> 2\n"
+    "  case 3 -> 3\n"
+    "  case 4 case 5 case 6 -> 4\n"
+    "  case 7 -> 5\n"
+    "  case 8 -> 6\n"
+    "  case 9 case 10 -> 7\n"
+    "  case 11 -> 8\n"
+    "  case 12 -> 9\n"
+    "  case m when m > 12 -> m\n"
+    "}\n"
+    "func sum(lo, hi) -> {\n"
+    "  if hi - lo <= 4 then return classify(lo) + classify(lo + 1) + classify(lo + 2) + classify(lo + 3)\n"
+    "  let mid = lo + (hi - lo) / 2\n"
+    "  return sum(lo, mid) + sum(mid, hi)\n"
+    "}\n"
+    "sum(0, SCALE * 16384)\n";
+
+// time one execution in seconds
+static double timed(Compiler& compiler, ExprPtr tree, Value& result) {
+    auto start = std::chrono::steady_clock::now();
+    result = compiler.execute(tree);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static void measure(const char* name, const char* program, int scale) {
+    std::string code = program;
+    const std::string scale_text = sformat("%d", scale);
+    code.replace(code.find("SCALE"), 5, scale_text);
+
+    Source source;
+    source.assign(sformat("%s.rath", name), code);
+
+    Compiler compiler;
+    ExprPtr tree = compiler.parse(source);
+    if (!compiler.analyze(&tree))
+        return;
+
+    double tree_best = 0, vm_best = 0;
+    Value tree_result, vm_result;
+    for (int run = 0; run < 5; run++) {
+        compiler.options.vm = false;
+        const double tree_time = timed(compiler, tree, tree_result);
+        compiler.options.vm = true;
+        const double vm_time = timed(compiler, tree, vm_result);
+
+        if (run == 0 || tree_time < tree_best) tree_best = tree_time;
+        if (run == 0 || vm_time < vm_best) vm_best = vm_time;
+    }
+
+    std::printf("%s: tree %.4fs, vm %.4fs, %.2fx\n", name, tree_best, vm_best, tree_best / vm_best);
+    if (!tree_result.equals(vm_result))
+        std::printf("  result mismatch\n");
+}
+
+int main(int argc, char** argv) {
+    const int scale = argc > 1 ? std::atoi(argv[1]) : 32;
+
+    try {
+        measure("arith", arith_program, scale);
+        measure("calls", call_program, scale);
+        measure("switch", switch_program, scale);
+    } catch (const std::exception& err) {
+        std::fprintf(stderr, "%s\n", err.what());
+        return 1;
+    }
+    return 0;
+}
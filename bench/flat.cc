@@ -0,0 +1,125 @@
+// Memory per node and traversal speed of the pointer tree versus the
+// flat index based ast.
+//
+//   make bench CFLAGS="-std=c++11 -O2 -c" BUILD_DIR=build/release
+//   build/release/bench/flat [megabytes]
+
+#include "bench/generate.hh"
+#include "src/compiler.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+
+#define count_list(list) \
+    for (auto e : list) count += tree_walk(e)
+
+// count the constants of a tree the way every tree pass visits nodes
+static std::size_t tree_walk(ExprPtr expr) {
+    if (!expr) return 0;
+    std::size_t count = 0;
+    switch (expr->type) {
+        case EConst: count = 1; break;
+        case EUnop: count += tree_walk(expr->as<Unop>()->value); break;
+        case EBinop:
+            count += tree_walk(expr->as<Binop>()->left);
+            count += tree_walk(expr->as<Binop>()->right);
+            break;
+        case EReturn: count += tree_walk(expr->as<Return>()->value); break;
+        case ECall: count_list(expr->as<Call>()->args); break;
+        case EBlock: count_list(expr->as<Block>()->body); break;
+        case ESwitch:
+            count += tree_walk(expr->as<Switch>()->value);
+            count_list(expr->as<Switch>()->cases);
+            break;
+        case ECaseCond:
+            count += tree_walk(expr->as<CaseCondition>()->value);
+            count += tree_walk(expr->as<CaseCondition>()->condition);
+            break;
+        case ECase:
+            count += tree_walk(expr->as<Case>()->body);
+            count += tree_walk(expr->as<Case>()->condition);
+            break;
+        case EFunction:
+            count_list(expr->as<Function>()->args);
+            count += tree_walk(expr->as<Function>()->body);
+            break;
+        case EAssign:
+            count_list(expr->as<Assign>()->vars);
+            count += tree_walk(expr->as<Assign>()->value);
+            break;
+        case EIf:
+            count += tree_walk(expr->as<If>()->condition);
+            count += tree_walk(expr->as<If>()->body);
+            count += tree_walk(expr->as<If>()->else_body);
+            break;
+        default: break;
+    }
+    return count;
+}
+
+// the same visit over the flat ast is a linear sweep
+static std::size_t flat_walk(const FlatAst& ast) {
+    std::size_t count = 0;
+    for (const FlatNode& node : ast.nodes)
+        count += node.type == EConst;
+    return count;
+}
+
+// time one call in seconds
+static double timed(const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+#define keep_best(best, value) do {                          \
+        const double seconds = (value);                         \
+        if (run == 0 || seconds < (best)) (best) = seconds;     \
+    } while (0)
+
+static void measure(const char* name, const Source& source) {
+    double tree_walk_best = 0, tree_fold_best = 0;
+    double flat_build_best = 0, flat_walk_best = 0, flat_fold_best = 0;
+    std::size_t nodes = 0, tree_consts = 0, flat_consts = 0;
+    std::size_t tree_bytes = 0, flat_bytes = 0;
+
+    for (int run = 0; run < 5; run++) {
+        // every run folds a freshly parsed tree
+        Compiler compiler;
+        FlatAst flat;
+        ExprPtr tree = compiler.parse(source);
+        tree_bytes = compiler.arena_used();
+
+        keep_best(tree_walk_best, timed([&] { tree_consts = tree_walk(tree); }));
+        keep_best(flat_build_best, timed([&] { flat.build(tree); }));
+        keep_best(flat_walk_best, timed([&] { flat_consts = flat_walk(flat); }));
+        nodes = flat.nodes.size();
+        flat_bytes = flat.bytes();
+
+        keep_best(flat_fold_best, timed([&] { compiler.optimize(flat); }));
+        keep_best(tree_fold_best, timed([&] { compiler.optimize(tree); }));
+    }
+
+    const double mb = double(source.size) / (1 << 20);
+    std::printf("%s: %.1f MB, %lu nodes, %lu constants\n", name, mb, nodes, tree_consts);
+    std::printf("  tree: %.1f bytes/node, walk %.4fs, fold %.4fs\n",
+        double(tree_bytes) / nodes, tree_walk_best, tree_fold_best);
+    std::printf("  flat: %.1f bytes/node, walk %.4fs, fold %.4fs, build %.4fs\n",
+        double(flat_bytes) / nodes, flat_walk_best, flat_fold_best, flat_build_best);
+    if (tree_consts != flat_consts)
+        std::printf("  constant count mismatch: %lu\n", flat_consts);
+}
+
+int main(int argc, char** argv) {
+    const std::size_t megabytes = argc > 1 ? std::atoi(argv[1]) : 8;
+
+    Source mixed, arith;
+    mixed.assign("mixed.rath", generate(megabytes << 20));
+    arith.assign("arith.rath", generate_arith(megabytes << 20));
+
+    measure("mixed", mixed);
+    measure("arith", arith);
+    return 0;
+}
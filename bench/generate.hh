@@ -0,0 +1,54 @@
+#pragma once
+
+// synthetic rath sources shared by the benches
+
+#include "src/ast.hh"
+
+// synthetic rath source mixing every token class, with the occasional
+// long identifier and string literal like our generated configs have
+static inline std::string generate(std::size_t target) {
+    std::string code;
+    code.reserve(target + 512);
+    std::string long_ident(48, 'x');
+    std::string long_str(240, 's');
+
+    for (std::size_t line = 0; code.size() < target; line++) {
+        code += sformat("let value_%lu = compute_item(alpha_%lu * 42, \"label %lu\") + 3.14159 >> 2\n",
+            line, line % 97, line);
+        code += sformat("func handler_%lu(const a, ref b) -> { return a <= b && b != %lu }\n",
+            line, line);
+        code += "switch key -> {\n    case 1 case 2 -> \"low\"\n    case n when n > 10 -> n % 7\n}\n";
+        if (line % 16 == 0)
+            code += "let " + long_ident + sformat("_%lu", line) + " = \"" + long_str + "\"\n";
+    }
+
+    return code;
+}
+
+// config style source dominated by long identifiers and string literals
+static inline std::string generate_long(std::size_t target) {
+    std::string code;
+    code.reserve(target + 4096);
+    std::string ident(60, 'k');
+    std::string value(1000, 'v');
+
+    for (std::size_t line = 0; code.size() < target; line++)
+        code += "let " + ident + sformat("_%lu", line) + " = \"" + value + "\"\n";
+
+    return code;
+}
+
+// arithmetic heavy source where most expressions fold to constants
+static inline std::string generate_arith(std::size_t target) {
+    std::string code;
+    code.reserve(target + 512);
+
+    for (std::size_t line = 0; code.size() < target; line++) {
+        code += sformat("let c_%lu = (%lu + 3) * 4 - %lu / 2 + x_%lu * (7 - 5)\n",
+            line, line, line + 1, line % 31);
+        code += sformat("let f_%lu = 1.5 * %lu.25 + -2 - y << 1\n", line, line % 1000);
+        code += sformat("let s_%lu = \"key\" + \"_\" + name_%lu\n", line, line % 17);
+    }
+
+    return code;
+}
@@ -0,0 +1,52 @@
+// Lexer throughput on a large synthetic rath file.
+//
+//   make bench CFLAGS="-std=c++11 -O2 -c" BUILD_DIR=build/release
+//   build/release/bench/lexer [megabytes]
+
+#include "bench/generate.hh"
+#include "src/scan.hh"
+
+#include <chrono>
+#include <cstdlib>
+
+// best time of lexing the whole source a few times
+static double measure(const Source& source, std::size_t& tokens) {
+    Lexer lexer;
+    double best = 0;
+
+    for (int run = 0; run < 10; run++) {
+        auto start = std::chrono::steady_clock::now();
+        lexer.feed(source);
+        tokens = 0;
+        while (lexer.next())
+            tokens++;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < best)
+            best = elapsed.count();
+    }
+
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const std::size_t megabytes = argc > 1 ? std::atoi(argv[1]) : 32;
+    const char* names[] = { "mixed", "long" };
+    std::string (*generators[])(std::size_t) = { generate, generate_long };
+
+    for (int input = 0; input < 2; input++) {
+        Source source;
+        source.assign("bench.rath", generators[input](megabytes << 20));
+        const double mb = double(source.size) / (1 << 20);
+
+        for (int level = ScanScalar; level <= scan_detect(); level++) {
+            std::size_t tokens = 0;
+            scan_use(ScanLevel(level));
+            const double best = measure(source, tokens);
+            std::printf("lexer %s (%s): %.1f MB, %lu tokens, best %.3fs, %.1f MB/s, %.1f Mtokens/s\n",
+                names[input], scan_level_str(ScanLevel(level)), mb, tokens,
+                best, mb / best, tokens / best / 1e6);
+        }
+    }
+
+    return 0;
+}
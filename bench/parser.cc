@@ -0,0 +1,44 @@
+// Parsing with streaming lexing versus a pre-lexed token buffer.
+//
+//   make bench CFLAGS="-std=c++11 -O2 -c" BUILD_DIR=build/release
+//   build/release/bench/parser [megabytes]
+
+#include "bench/generate.hh"
+
+#include <chrono>
+#include <cstdlib>
+
+// best time of parsing the whole source a few times
+static double measure(Parser& parser, const Source& source) {
+    double best = 0;
+
+    for (int run = 0; run < 10; run++) {
+        auto start = std::chrono::steady_clock::now();
+        parser.parse(source);
+        parser.arena.release();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < best)
+            best = elapsed.count();
+    }
+
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const std::size_t megabytes = argc > 1 ? std::atoi(argv[1]) : 16;
+    const char* modes[] = { "streaming", "prelex" };
+
+    Source source;
+    source.assign("bench.rath", generate(megabytes << 20));
+    const double mb = double(source.size) / (1 << 20);
+
+    for (int prelex = 0; prelex < 2; prelex++) {
+        Parser parser;
+        parser.prelex = prelex;
+        const double best = measure(parser, source);
+        std::printf("parser (%s): %.1f MB, best %.3fs, %.1f MB/s\n",
+            modes[prelex], mb, best, mb / best);
+    }
+
+    return 0;
+}
@@ -1,21 +1,339 @@
 #include "compiler.hh"
 
-#include <map>
+#include <algorithm>
 
-struct Scope {
-    Scope *previous;
-    std::map<std::string, Var*> vars;
-    Scope(Scope* last = nullptr) : previous(last) {}
+// Scope chain for name resolution. Symbols are dense ids, so the
+// innermost binding of every name sits directly in a table indexed by
+// symbol. Declaring a name logs the binding it shadows, leaving a scope
+// undoes the log back to the mark taken when the scope was entered.
+//
+// Each declaration also takes the next slot of the frame of the
+// function it is declared in. Slots of a scope are reused once the
+// scope is left, the frame size is the most slots live at once.
+// Closures hold the frame itself, so a scope with a captured local
+// keeps its slots for the rest of the frame instead.
+class Resolver {
+public:
+    // visible declaration of a name, level is the function nesting
+    // depth of the frame holding its slot and captured the serial of
+    // the innermost frame that has recorded it as a capture
+    struct Binding {
+        ExprPtr decl;
+        std::uint32_t level;
+        std::uint32_t slot;
+        std::uint32_t captured;
+    };
 
-    Var* find(const std::string& name) {
-        auto v = vars.find(name);
-        if (v == vars.end())
-            return previous ? previous->find(name) : nullptr;
-        return v->second;
+    // undo log position and next free slot when a scope was entered
+    struct Scope {
+        std::size_t log;
+        std::uint32_t next;
+    };
+
+private:
+    struct Undo {
+        Symbol symbol;
+        Binding shadowed;
+    };
+
+    // serials grow in the order frames are entered, so the frames
+    // entered after a capture are the innermost ones with a larger serial.
+    // Slots below floor belong to captured scopes and are never reused.
+    struct Frame {
+        Function* function;
+        std::uint32_t serial;
+        std::uint32_t next;
+        std::uint32_t floor;
+        std::uint32_t size;
+    };
+
+    std::vector<Binding> bindings;
+    std::vector<Undo> log;
+    std::vector<Frame> frames;
+    std::uint32_t serials = 0;
+
+public:
+    // operators of the left deep chains being walked
+    std::vector<Binop*> spine;
+
+    void reset(std::size_t symbols) {
+        bindings.assign(symbols, Binding { nullptr, 0, 0, 0 });
+        log.clear();
+        frames.assign(1, Frame { nullptr, 0, 0, 0, 0 });
+        serials = 0;
+    }
+
+    inline Scope enter() const {
+        return Scope { log.size(), frames.back().next };
+    }
+
+    inline void leave(const Scope& scope) {
+        Frame& frame = frames.back();
+        while (log.size() > scope.log) {
+            Binding& binding = bindings[log.back().symbol];
+            if (binding.captured && binding.level == level())
+                frame.floor = std::max(frame.floor, frame.next);
+            binding = log.back().shadowed;
+            log.pop_back();
+        }
+        frame.next = std::max(scope.next, frame.floor);
+    }
+
+    // frame of a function body, its size is returned when left
+    inline void enter_frame(Function* function) {
+        frames.push_back(Frame { function, ++serials, 0, 0, 0 });
+    }
+
+    inline std::uint32_t leave_frame() {
+        const std::uint32_t size = frames.back().size;
+        frames.pop_back();
+        return size;
+    }
+
+    // bind a name to the next slot of the current frame
+    inline std::uint32_t declare(Symbol symbol, ExprPtr decl) {
+        Frame& frame = frames.back();
+        const std::uint32_t slot = frame.next++;
+        frame.size = std::max(frame.size, frame.next);
+        log.push_back(Undo { symbol, bindings[symbol] });
+        bindings[symbol] = Binding { decl, level(), slot, 0 };
+        return slot;
+    }
+
+    inline const Binding& find(Symbol symbol) const {
+        return bindings[symbol];
+    }
+
+    inline std::uint32_t level() const {
+        return std::uint32_t(frames.size() - 1);
+    }
+
+    inline std::uint32_t frame_size() const {
+        return frames.back().size;
+    }
+
+    // record the declaration a name is bound to in an outer frame as
+    // captured by every function between that frame and the current
+    // one. Frames that recorded it before are not visited again.
+    void capture(Symbol symbol) {
+        Binding& binding = bindings[symbol];
+        if (binding.decl->is(EConst))
+            binding.decl->as<Var>()->flags |= Var::Flag::Captured | Var::Flag::Escapes;
+
+        for (std::size_t level = frames.size() - 1; level > binding.level; level--) {
+            if (frames[level].serial <= binding.captured)
+                break;
+
+            // closures walk up through every frame to the declaring one
+            if (frames[level - 1].function)
+                frames[level - 1].function->frame_captured = true;
+            frames[level].function->captures.push_back(binding.decl);
+        }
+        binding.captured = frames.back().serial;
     }
 };
 
+static void resolve(Resolver& r, ExprPtr expr);
+
+// declare a variable, it resolves to itself
+static inline void resolve_declare(Resolver& r, Var* var) {
+    var->flags &= ~(Var::Flag::Captured | Var::Flag::Escapes | Var::Flag::Assigned);
+    var->decl = var;
+    var->depth = 0;
+    var->slot = r.declare(var->symbol, var);
+}
+
+// point a reference at the lexical address of its declaration
+template <typename T>
+static inline void resolve_use(Resolver& r, T* use) {
+    const Resolver::Binding& binding = r.find(use->symbol);
+    use->decl = binding.decl;
+    if (binding.decl) {
+        use->depth = r.level() - binding.level;
+        use->slot = binding.slot;
+        if (use->depth > 0)
+            r.capture(use->symbol);
+    }
+}
+
+// mark the local a ref binding or ref argument aliases as escaping
+static inline void escape_ref(ExprPtr value) {
+    if (value && value->is(EConst) && value->as<Const>()->const_type == EConstIdent) {
+        Expr* decl = value->as<Var>()->decl;
+        if (decl && decl->is(EConst))
+            decl->as<Var>()->flags |= Var::Flag::Escapes;
+    }
+}
+
+// parameter of a known function an argument is passed to
+static inline Var* call_param(Function* func, std::size_t index) {
+    if (index < func->args.size())
+        return func->args[index];
+    if (!func->args.empty() && (func->args.back()->flags & Var::Flag::Packed))
+        return func->args.back();
+    return nullptr;
+}
+
+// Arguments to ref parameters escape. Calls through a variable may
+// reach any function so all their arguments are assumed to, while
+// unresolved names are builtins taking their arguments by value.
+static inline void escape_args(Call* call) {
+    if (!call->decl)
+        return;
+
+    Function* func = call->decl->is(EFunction) ? call->decl->as<Function>() : nullptr;
+    for (std::size_t i = 0; i < call->args.size(); i++) {
+        Var* param = func ? call_param(func, i) : nullptr;
+        if (!func || (param && (param->flags & Var::Flag::Ref)))
+            escape_ref(call->args[i]);
+    }
+}
+
+#define resolve_list(list) \
+    for (auto e : list) resolve(r, e)
+
+static void resolve(Resolver& r, ExprPtr expr) {
+    if (!expr) return;
+    switch (expr->type) {
+
+        case EConst:
+            if (expr->as<Const>()->const_type == EConstIdent)
+                resolve_use(r, expr->as<Var>());
+            break;
+
+        case EUnop:
+            resolve(r, expr->as<Unop>()->value);
+            break;
+
+        // left deep chains like a + b + c are walked along their spine
+        // instead of recursing once per operator
+        case EBinop: {
+            const std::size_t mark = r.spine.size();
+            for (ExprPtr link = expr; link && link->is(EBinop); link = link->as<Binop>()->left)
+                r.spine.push_back(link->as<Binop>());
+            resolve(r, r.spine.back()->left);
+            for (std::size_t i = r.spine.size(); i > mark; i--) {
+                Binop* e = r.spine[i - 1];
+                if ((e->op == OpAssign || e->op == OpUpdate) && e->left && e->left->is(EConst)
+                    && e->left->as<Const>()->const_type == EConstIdent) {
+                    Expr* decl = e->left->as<Var>()->decl;
+                    if (decl && decl->is(EConst))
+                        decl->as<Var>()->flags |= Var::Flag::Assigned;
+                }
+                // the right side of a member access is a field name
+                if (e->op != OpDot || !e->right || !e->right->is(EConst))
+                    resolve(r, e->right);
+            }
+            r.spine.resize(mark);
+            break;
+        }
+
+        case EReturn:
+            resolve(r, expr->as<Return>()->value);
+            break;
+
+        case ECall: {
+            Call* e = expr->as<Call>();
+            resolve_use(r, e);
+            resolve_list(e->args);
+            escape_args(e);
+            break;
+        }
+
+        case EBlock: {
+            const Resolver::Scope scope = r.enter();
+            resolve_list(expr->as<Block>()->body);
+            r.leave(scope);
+            break;
+        }
+
+        case ESwitch: {
+            Switch* e = expr->as<Switch>();
+            resolve(r, e->value);
+            resolve_list(e->cases);
+            break;
+        }
+
+        // the bindings of a case pattern are visible in its body
+        case ECase: {
+            Case* e = expr->as<Case>();
+            const Resolver::Scope scope = r.enter();
+            resolve(r, e->condition);
+            resolve(r, e->body);
+            r.leave(scope);
+            break;
+        }
+
+        // `case n when ...` binds the switch value to n
+        case ECaseCond: {
+            CaseCondition* e = expr->as<CaseCondition>();
+            if (!e->is_direct && e->value && e->value->is(EConst)
+                && e->value->as<Const>()->const_type == EConstIdent)
+                resolve_declare(r, e->value->as<Var>());
+            else
+                resolve(r, e->value);
+            resolve(r, e->condition);
+            break;
+        }
+
+        // a named function takes a slot of the enclosing frame and
+        // is visible in its own body for recursion
+        case EFunction: {
+            Function* e = expr->as<Function>();
+            e->captures.clear();
+            e->frame_captured = false;
+            if (e->name.size > 0)
+                e->slot = r.declare(e->symbol, e);
+            const Resolver::Scope scope = r.enter();
+            r.enter_frame(e);
+            for (Var* arg : e->args)
+                resolve_declare(r, arg);
+            resolve(r, e->body);
+            e->frame_size = r.leave_frame();
+            r.leave(scope);
+            break;
+        }
+
+        // the value is resolved before the new names become visible
+        case EAssign: {
+            Assign* e = expr->as<Assign>();
+            resolve(r, e->value);
+            for (Var* var : e->vars) {
+                resolve_declare(r, var);
+                if (var->flags & Var::Flag::Ref)
+                    escape_ref(e->value);
+            }
+            break;
+        }
+
+        case EIf: {
+            If* e = expr->as<If>();
+            resolve(r, e->condition);
+            resolve(r, e->body);
+            resolve(r, e->else_body);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+#undef resolve_list
+
+// Names are resolved once for the optimizer to see through them, and
+// again on the tree it leaves since it may drop or replace their uses.
 bool Compiler::analyze(ExprPtr* tree) {
+    Resolver resolver;
+    resolver.reset(parser.symbols.size());
+    resolve(resolver, *tree);
+
     *tree = optimize(*tree);
+    if (options.pass_stats)
+        optimizer.report();
+
+    resolver.reset(parser.symbols.size());
+    resolve(resolver, *tree);
+    frame_size = resolver.frame_size();
     return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,72 @@
+#include "ast.hh"
+
+#include <cstdlib>
+
+// memory chunk owned by an arena, allocations follow the header
+struct Arena::Chunk {
+    Chunk* next;
+    std::size_t size;
+
+    inline char* begin() {
+        return reinterpret_cast<char*>(this) + header_size();
+    }
+
+    static constexpr std::size_t header_size() {
+        return (sizeof(Chunk) + alignof(std::max_align_t) - 1)
+            & ~(alignof(std::max_align_t) - 1);
+    }
+};
+
+Arena::~Arena() {
+    Chunk* chunk = head;
+    while (chunk) {
+        Chunk* next = chunk->next;
+        std::free(chunk);
+        chunk = next;
+    }
+}
+
+void Arena::release() {
+    current = head;
+    cursor = head ? head->begin() : nullptr;
+    limit = head ? head->begin() + head->size : nullptr;
+}
+
+std::size_t Arena::used() const {
+    if (!current) return 0;
+    std::size_t bytes = 0;
+    for (Chunk* chunk = head; chunk != current; chunk = chunk->next)
+        bytes += chunk->size;
+    return bytes + std::size_t(cursor - current->begin());
+}
+
+void* Arena::grow(std::size_t size, std::size_t align) {
+    // reuse chunks kept from before the last release when they fit
+    Chunk* chunk = current ? current->next : head;
+    Chunk* last = current;
+    while (chunk && chunk->size < size + align) {
+        last = chunk;
+        chunk = chunk->next;
+    }
+
+    if (!chunk) {
+        const std::size_t bytes = std::max(chunk_size, size + align);
+        chunk = static_cast<Chunk*>(std::malloc(Chunk::header_size() + bytes));
+        if (!chunk) throw std::bad_alloc();
+        chunk->size = bytes;
+        chunk->next = nullptr;
+        if (last) last->next = chunk;
+        else head = chunk;
+    }
+
+    current = chunk;
+    cursor = chunk->begin();
+    limit = cursor + chunk->size;
+    return alloc(size, align);
+}
+
+StrView Arena::copy(const StrView& str) {
+    char* data = static_cast<char*>(alloc(str.size, 1));
+    std::memcpy(data, str.data, str.size);
+    return StrView(data, str.size);
+}
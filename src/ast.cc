@@ -1,11 +1,10 @@
 #include "ast.hh"
 
-std::size_t strcount(const std::string& str, const char c) {
-    register std::size_t pos = 0, count = 0;
-    while ((pos = str.find(c, pos)) < str.size()) {
-        count++;
-        pos++;
-    }
+std::size_t strcount(const StrView& str, const char c) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < str.size; i++)
+        if (str.data[i] == c)
+            count++;
     return count;
 }
 
@@ -20,7 +19,15 @@ bool Token::is(TokenType type) const {
     return this->type == type;
 }
 
-bool Token::is(const std::string& text) const {
+bool Token::is(KeywordKind keyword) const {
+    return type == Keyword && id == keyword;
+}
+
+bool Token::is(OpKind op) const {
+    return (type == Operator || type == Arrow) && id == op;
+}
+
+bool Token::is(const StrView& text) const {
     return this->text == text;
 }
 
@@ -36,8 +43,8 @@ const char* Token::type_str(TokenType type) {
 }
 
 std::string Token::debug() const {
-    return std::move(sformat("[%s %s]",
-        token_type_map[type], text.c_str()));
+    return sformat("[%s %.*s]",
+        token_type_map[type], (int)text.size, text.data);
 }
 
 ///////////////////////////////////////////////////////////////
@@ -69,8 +76,9 @@ void Const::print() const {
     std::printf("[Const %s]", Const::type_str(const_type));
 }
 
+// ints are stored unsigned but evaluate signed, print the value they have
 void ConstInt::print() const {
-    std::printf("[%s %lu]", Const::type_str(const_type), value);
+    std::printf("[%s %ld]", Const::type_str(const_type), std::int64_t(value));
 }
 
 void ConstFloat::print() const {
@@ -78,26 +86,26 @@ void ConstFloat::print() const {
 }
 
 void ConstString::print() const {
-    std::printf("[%s \"%s\"]", Const::type_str(const_type), value.c_str());
+    std::printf("[%s \"%.*s\"]", Const::type_str(const_type), (int)value.size, value.data);
 }
 
 void Var::print() const {
-    std::printf("[%s%s%s%s%s]",
+    std::printf("[%s%s%s%s%.*s]",
         Const::type_str(const_type),
         flags & Flag::Const ? " const " : "",
         flags & Flag::Ref ? " ref " : "",
         flags & Flag::Const ? " ... " : " ",
-        name.c_str());
+        (int)name.size, name.data);
 }
 
 void Unop::print() const {
-    std::printf("[Unop(%s) ", token.text.c_str());
+    std::printf("[Unop(%s) ", Token::op_str(op));
     if (value) value->print();
     std::printf("]");
 }
 
 void Binop::print() const {
-    std::printf("[Binop(%s) ", token.text.c_str());
+    std::printf("[Binop(%s) ", Token::op_str(op));
     std::printf("left="); if (left) left->print(); else std::printf("null");
     std::printf(" right="); if (right) right->print(); else std::printf("null");
     std::printf("]");
@@ -110,7 +118,7 @@ void Return::print() const {
 }
 
 void Call::print() const {
-    std::printf("[Call%s%s args={", name.size() > 0 ? " " : "", name.c_str());
+    std::printf("[Call%s%.*s args={", name.size > 0 ? " " : "", (int)name.size, name.data);
     for (std::size_t i = 0; i < args.size(); i++) {
         if (args[i]) args[i]->print();
         if (i < args.size() - 1) std::printf(", ");
@@ -150,8 +158,8 @@ void Switch::print() const {
 }
 
 void Function::print() const {
-    const char* space = name.size() > 0 ? " " : "";
-    std::printf("[Func%s%s%sargs={", space, name.c_str(), space);
+    const char* space = name.size > 0 ? " " : "";
+    std::printf("[Func%s%.*s%sargs={", space, (int)name.size, name.data, space);
     for (std::size_t i = 0; i < args.size(); i++) {
         if (args[i]) args[i]->print();
         if (i < args.size() - 1) std::printf(", ");
@@ -1,398 +1,709 @@
-#pragma once
-
-#include <queue>
-#include <string>
-#include <memory>
-#include <cstdio>
-#include <vector>
-#include <cstdint>
-#include <exception>
-
-// token types
-typedef enum {
-    None      = 0,
-    Eof       = 1,
-    Ident     = 2,
-    String    = 3,
-    Number    = 4,
-    Keyword   = 5,
-    Operator  = 6,
-    LParen    = 7,
-    RParen    = 8,
-    LCurly    = 9,
-    RCurly    = 10,
-    LBracket  = 11,
-    RBracket  = 12,
-    Comma     = 13,
-    Arrow     = 14,
-    Semicolon = 15,
-    Newline   = 16
-} TokenType;
-
-// changeable keywords
-#define KeywordSwitch "switch"
-#define KeywordCase "case"
-#define KeywordWhen "when"
-#define KeywordIf "if"
-#define KeywordElse "else"
-#define KeywordThen "then"
-#define KeywordDeclare "let"
-#define KeywordImport "open"
-#define KeywordReturn "return"
-#define KeywordFunction "func"
-#define KeywordNull "null"
-#define KeywordThis "this"
-#define KeywordRef "ref"
-#define KeywordConst "const"
-
-// token object
-class Token {
-public:
-    TokenType type;
-    std::string text;
-    std::size_t start;
-    std::size_t lineno;
-
-    static const char* type_str(TokenType);
-
-    Token() : Token(None) {}
-    Token(TokenType _type) : type(_type) {}
-    Token(TokenType _type, const std::string& _text,
-        const std::size_t& _start, const std::size_t& _lineno)
-        : type(_type), text(_text), start(_start), lineno(_lineno) {}
-
-    operator bool() const;
-    std::string debug() const;
-    bool is(TokenType type) const;
-    bool is(const std::string& text) const;
-};
-
-// lexer interface
-class Lexer {
-public:
-    std::string code;
-    std::string file;
-    std::size_t lineno;
-    std::size_t current;
-
-    Lexer() = default;
-    Token next();
-    Lexer& feed(const std::string& filename, const std::string& code);
-};
-
-// count occurances of char in string
-std::size_t strcount(const std::string& str, const char c);
-
-// format a string using sprintf
-template <typename ...Args>
-std::string sformat(const std::string& format, Args... args) {
-    std::size_t size = std::snprintf(nullptr, 0, format.c_str(), args...) + 1;
-    std::unique_ptr<char[]> buf(new char[size]);
-    std::snprintf(buf.get(), size, format.c_str(), args...);
-    return std::string(buf.get(), buf.get() + size - 1);
-}
-
-// Custome error object
-class ParserError : public std::exception {
-public:
-    std::string message;
-
-    ParserError(const std::string& msg) : message(msg) {}
-    const char* what() const throw() {
-        return message.c_str();
-    }
-
-    template <typename ...Args>
-    static ParserError from(
-        const Lexer& lexer,
-        std::size_t start,
-        const std::string& filename,
-        const std::size_t& lineno,
-        const std::string& format,
-        Args... args)
-    {
-        // find start line of error
-        while (start > 0 && lexer.code[start - 1] != '\n')
-            start--;
-        
-        // get rid of beginning whitepace
-        parse_trim_front:
-        switch (lexer.code[start]) {
-            case ' ': case '\t': case '\r':
-                start++;
-                goto parse_trim_front;
-            default:
-                break;
-        }
-        // find end line of error
-        std::size_t end = lexer.code.find('\n', start);
-        if (end == std::string::npos) end = lexer.code.size();
-
-        // create error text
-        std::string err = sformat("Error in %s:%lu:\n%.*s\n  > %s\n",
-            filename.c_str(), lineno, (int)(end - start),
-            lexer.code.c_str() + start, sformat(format, args...).c_str());
-        
-        // return parser error object
-        return ParserError(err);
-    }
-};
-
-////////////////////////////////////////////////////////
-
-typedef enum {
-    EUnop     = 0,
-    EBinop    = 1,
-    EConst    = 2,
-    ECall     = 3,
-    EFunction = 4,
-    EReturn   = 5,
-    EBlock    = 6,
-    EIf       = 7,
-    ESwitch   = 8,
-    ECase     = 9,
-    ECaseCond = 10,
-    EAssign   = 11
-} ExprType;
-
-#define ExprPtr Expr*
-class Expr {
-public:
-    Token token;
-    ExprType type;
-
-    static const char* type_str(ExprType);
-
-    virtual ~Expr() = default;
-    Expr(ExprType _type, const Token& _token)
-        : token(_token), type(_type) {}
-
-    template <typename T>
-    inline T* as() {
-        return reinterpret_cast<T*>(this);
-    }
-
-    inline bool is(ExprType t) const {
-        return type == t;
-    }
-
-    inline ExprPtr ptr() {
-        return this;
-    }
-
-    template <typename T>
-    static void free(T** expr) {
-        if (expr) delete *expr;
-        *expr = nullptr;
-    }
-
-    template <typename T>
-    static void free_list(std::vector<T>& list) {
-        for (T expr : list) Expr::free(&expr);
-        list.clear();
-    }
-
-    virtual void print() const = 0;
-};
-
-typedef enum {
-    EConstInt    = 0,
-    EConstFloat  = 1,
-    EConstString = 2,
-    EConstIdent  = 3,
-    EConstNull   = 4,
-    EConstThis   = 5
-} ConstExprType;
-
-class Const : public Expr {
-public:
-    void print() const;
-    ConstExprType const_type;
-    Const(const Token& token, ConstExprType type)
-        : Expr(EConst, token), const_type(type) {}
-
-    static const char* type_str(ConstExprType type);
-};
-
-class ConstInt : public Const {
-public:
-    void print() const;
-    std::uint64_t value;
-    ConstInt(const Token& token, const std::uint64_t& _value)
-        : Const(token, EConstInt), value(_value) {}
-};
-
-class ConstFloat : public Const {
-public:
-    void print() const;
-    double value;
-    ConstFloat(const Token& token, const double& _value)
-        : Const(token, EConstFloat), value(_value) {}
-};
-
-class ConstString : public Const {
-public:
-    void print() const;
-    std::string value;
-    ConstString(const Token& token, const std::string& _value)
-        : Const(token, EConstString), value(_value) {}
-};
-
-class Var : public Const {
-public:
-    struct Flag {
-        static constexpr int 
-            Ref = 1 << 1,
-            Const = 1 << 2,
-            Packed = 1 << 3;
-    };
-
-    void print() const;
-    int flags = 0;
-    std::string name;
-    Var(const Token& token, const int& _flags, const std::string& _name)
-        : Const(token, EConstIdent), flags(_flags), name(_name) {}
-};
-
-class Unop : public Expr {
-public:
-    void print() const;
-    ExprPtr value;
-    ~Unop() { Expr::free(&value); }
-    Unop(const Token& token, ExprPtr _value)
-        : Expr(EUnop, token), value(_value) {}
-};
-
-class Binop : public Expr {
-public:
-    void print() const;
-    ExprPtr left;
-    ExprPtr right;
-    ~Binop() { Expr::free(&left); Expr::free(&right); }
-    Binop(const Token& token, ExprPtr _left, ExprPtr _right)
-        : Expr(EBinop, token), left(_left), right(_right) {}
-};
-
-class Return : public Expr {
-public:
-    void print() const;
-    ExprPtr value;
-    ~Return() { Expr::free(&value); }
-    Return(const Token& token, ExprPtr _value)
-        : Expr(EReturn, token), value(_value) {}
-};
-
-class Call : public Expr {
-public:
-    void print() const;
-    std::string name;
-    std::vector<ExprPtr> args;
-    ~Call() { Expr::free_list(args); }
-    Call(const Token& token, const std::string& _name)
-        : Expr(ECall, token), name(_name) {}
-};
-
-class Block : public Expr {
-public:
-    void print() const;
-    std::vector<ExprPtr> body;
-    ~Block() { Expr::free_list(body); }
-    Block(const Token& token) : Expr(EBlock, token) {}
-};
-
-class Case;
-class Switch : public Expr {
-public:
-    void print() const;
-    ExprPtr value;
-    std::vector<Case*> cases;
-    ~Switch() { Expr::free(&value); Expr::free_list(cases); }
-    Switch(const Token& token, ExprPtr _value)
-        : Expr(ESwitch, token), value(_value) {}
-};
-
-class CaseCondition : public Expr {
-public:
-    void print() const;
-    ExprPtr value;
-    ExprPtr condition;
-    bool is_direct = true;
-    CaseCondition(const Token& token, ExprPtr _value, ExprPtr _condition)
-        : Expr(ECaseCond, token), value(_value), condition(_condition) {}
-    ~CaseCondition() {
-        Expr::free(&value);
-        if (is_direct && condition && condition->is(EBinop)) {
-            Binop* op = condition->as<Binop>();
-            op->left = nullptr;
-            op->right = nullptr;
-            delete op;
-        }
-    }
-};
-
-class Case : public Expr {
-public:
-    void print() const;
-    ExprPtr body;
-    CaseCondition* condition;
-    ~Case() { Expr::free(&body); Expr::free(&condition); }
-    Case(const Token& token, ExprPtr _body, CaseCondition* _condition)
-        : Expr(ECase, token), body(_body), condition(_condition) {}
-};
-
-class Function : public Expr {
-public:
-    void print() const;
-    ExprPtr body;
-    std::string name;
-    std::vector<Var*> args;
-    ~Function() { Expr::free(&body); Expr::free_list(args); }
-    Function(const Token& token, const std::string& _name)
-        : Expr(EFunction, token), name(_name) {}
-};
-
-class Assign : public Expr {
-public:
-    void print() const;
-    ExprPtr value;
-    std::vector<Var*> vars;
-    ~Assign() { Expr::free(&value); Expr::free_list(vars); }
-    Assign(const Token& token, ExprPtr _value)
-        : Expr(EAssign, token), value(_value) {}
-};
-
-class If : public Expr {
-public:
-    void print() const;
-    ExprPtr body;
-    ExprPtr else_body;
-    ExprPtr condition;
-    ~If() { Expr::free(&body); Expr::free(&else_body); Expr::free(&condition); }
-    If(const Token& token, ExprPtr x, ExprPtr y, ExprPtr z)
-        : Expr(EIf, token), body(x), else_body(y), condition(z) {}
-};
-
-class Parser {
-private:
-    Lexer lexer;
-    std::queue<Token> peeks;
-    Token consume_error(TokenType, const std::string&, bool, bool);
-
-public:
-    Token current;
-
-    Parser() {};
-    Token next();
-    Token peek();
-    ExprPtr parse(const std::string& filename, const std::string& code);
-
-    Token consume(bool maybe = false);
-    Token consume(TokenType, bool maybe = false);
-    Token consume(const std::string&, bool maybe = false);
-    Token consume(TokenType, const std::string&, bool maybe = false, bool has_type = true);
-
-    template <typename ...Args>
-    void error(const Token& token, const std::string& format, Args... args) {
-        throw ParserError::from(lexer, token.start, lexer.file, token.lineno, format, args...);
-    }
+#pragma once
+
+#include <new>
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <exception>
+
+// token types
+typedef enum {
+    None      = 0,
+    Eof       = 1,
+    Ident     = 2,
+    String    = 3,
+    Number    = 4,
+    Keyword   = 5,
+    Operator  = 6,
+    LParen    = 7,
+    RParen    = 8,
+    LCurly    = 9,
+    RCurly    = 10,
+    LBracket  = 11,
+    RBracket  = 12,
+    Comma     = 13,
+    Arrow     = 14,
+    Semicolon = 15,
+    Newline   = 16
+} TokenType;
+
+// changeable keywords
+#define KeywordSwitch "switch"
+#define KeywordCase "case"
+#define KeywordWhen "when"
+#define KeywordIf "if"
+#define KeywordElse "else"
+#define KeywordThen "then"
+#define KeywordDeclare "let"
+#define KeywordImport "open"
+#define KeywordReturn "return"
+#define KeywordFunction "func"
+#define KeywordNull "null"
+#define KeywordThis "this"
+#define KeywordRef "ref"
+#define KeywordConst "const"
+
+// keyword ids, resolved by the lexer
+typedef enum {
+    KwNone     = 0,
+    KwSwitch   = 1,
+    KwCase     = 2,
+    KwWhen     = 3,
+    KwIf       = 4,
+    KwElse     = 5,
+    KwThen     = 6,
+    KwDeclare  = 7,
+    KwConst    = 8,
+    KwRef      = 9,
+    KwImport   = 10,
+    KwReturn   = 11,
+    KwFunction = 12,
+    KwCount    = 13
+} KeywordKind;
+
+// operator ids, resolved by the lexer
+typedef enum {
+    OpNone   = 0,
+    // math operators
+    OpAdd    = 1,  // +
+    OpSub    = 2,  // -
+    OpMul    = 3,  // *
+    OpDiv    = 4,  // /
+    OpMod    = 5,  // %
+    // binary operators
+    OpShl    = 6,  // <<
+    OpShr    = 7,  // >>
+    OpBitAnd = 8,  // &
+    OpBitXor = 9,  // ^
+    OpBitOr  = 10, // |
+    // assignment / access
+    OpDot    = 11, // .
+    OpAssign = 12, // =
+    OpUpdate = 13, // :=
+    OpArrow  = 14, // ->
+    OpSpread = 15, // ...
+    // comparison operators
+    OpGt     = 16, // >
+    OpLt     = 17, // <
+    OpGe     = 18, // >=
+    OpLe     = 19, // <=
+    OpEq     = 20, // ==
+    OpNe     = 21, // !=
+    OpAnd    = 22, // &&
+    OpOr     = 23, // ||
+    OpCount  = 24
+} OpKind;
+
+// non-owning view over a run of characters
+class StrView {
+public:
+    const char* data;
+    std::size_t size;
+
+    StrView() : data(nullptr), size(0) {}
+    StrView(const char* str) : data(str), size(std::strlen(str)) {}
+    StrView(const char* _data, const std::size_t& _size)
+        : data(_data), size(_size) {}
+
+    inline std::string str() const {
+        return std::string(data, size);
+    }
+
+    inline bool operator==(const StrView& other) const {
+        return size == other.size && std::memcmp(data, other.data, size) == 0;
+    }
+
+    inline bool operator!=(const StrView& other) const {
+        return !(*this == other);
+    }
+};
+
+// token object, text is a view into the source being lexed
+class Token {
+public:
+    TokenType type;
+    std::uint32_t id;
+    StrView text;
+    std::size_t start;
+
+    static const char* type_str(TokenType);
+    static const char* keyword_str(KeywordKind);
+    static const char* op_str(OpKind);
+
+    Token() : Token(None) {}
+    Token(TokenType _type, const std::size_t& _start = 0)
+        : type(_type), id(0), start(_start) {}
+    Token(TokenType _type, const StrView& _text,
+        const std::size_t& _start, const std::uint32_t& _id = 0)
+        : type(_type), id(_id), text(_text), start(_start) {}
+
+    operator bool() const;
+    std::string debug() const;
+    bool is(TokenType type) const;
+    bool is(KeywordKind keyword) const;
+    bool is(OpKind op) const;
+    bool is(const StrView& text) const;
+};
+
+// offsets where each line of a source starts, used to map
+// token offsets to line and column only when they are reported
+class LineIndex {
+public:
+    std::vector<std::size_t> starts;
+
+    void build(const StrView& code);
+
+    // 1 based line of an offset
+    std::size_t line(std::size_t offset) const;
+
+    // 1 based column of an offset
+    inline std::size_t column(std::size_t offset) const {
+        return offset - starts[line(offset) - 1] + 1;
+    }
+};
+
+// read-only source text, memory mapped for regular files
+class Source {
+private:
+    bool mapped = false;
+    std::string buffer;
+
+public:
+    std::string file;
+    const char* data = nullptr;
+    std::size_t size = 0;
+    LineIndex lines;
+
+    Source() = default;
+    Source(const Source&) = delete;
+    Source& operator=(const Source&) = delete;
+    ~Source();
+
+    void close();
+    Source& open(const std::string& path);
+    Source& assign(const std::string& filename, const std::string& code);
+
+    inline StrView view() const {
+        return StrView(data, size);
+    }
+};
+
+class Interner;
+
+// lexer interface, identifiers and string literals are interned
+// into symbols when a symbol table is attached
+class Lexer {
+public:
+    StrView code;
+    std::string file;
+    const LineIndex* lines;
+    std::size_t current;
+    Interner* symbols = nullptr;
+
+    Lexer() = default;
+    Token next();
+    Lexer& feed(const Source& source);
+};
+
+// whole source lexed up front into parallel arrays, so the parser
+// can walk it by index instead of interleaving with the lexer
+class TokenBuffer {
+public:
+    StrView code;
+    std::vector<std::uint8_t> types;
+    std::vector<std::uint32_t> ids;
+    std::vector<std::uint32_t> starts;
+    std::vector<std::uint32_t> lengths;
+
+    void fill(Lexer& lexer);
+
+    inline std::size_t size() const {
+        return types.size();
+    }
+
+    // reads past the end keep returning the trailing Eof
+    inline Token get(std::size_t index) const {
+        if (index >= types.size())
+            index = types.size() - 1;
+        return Token(TokenType(types[index]),
+            StrView(code.data + starts[index], lengths[index]),
+            starts[index], ids[index]);
+    }
+};
+
+// count occurances of char in string
+std::size_t strcount(const StrView& str, const char c);
+
+// format a string using sprintf
+template <typename ...Args>
+std::string sformat(const std::string& format, Args... args) {
+    std::size_t size = std::snprintf(nullptr, 0, format.c_str(), args...) + 1;
+    std::unique_ptr<char[]> buf(new char[size]);
+    std::snprintf(buf.get(), size, format.c_str(), args...);
+    return std::string(buf.get(), buf.get() + size - 1);
+}
+
+// chars of a long source line shown on each side of an error
+#define ErrorContext 60
+
+// Custome error object
+class ParserError : public std::exception {
+public:
+    std::string message;
+
+    ParserError(const std::string& msg) : message(msg) {}
+    const char* what() const throw() {
+        return message.c_str();
+    }
+
+    template <typename ...Args>
+    static ParserError from(
+        const Lexer& lexer,
+        std::size_t offset,
+        const std::string& format,
+        Args... args)
+    {
+        const char* code = lexer.code.data;
+        const std::size_t size = lexer.code.size;
+        if (offset > size) offset = size;
+
+        // locate the error and the bounds of its line
+        const std::vector<std::size_t>& starts = lexer.lines->starts;
+        const std::size_t line = lexer.lines->line(offset);
+        std::size_t start = starts[line - 1];
+        std::size_t end = line < starts.size() ? starts[line] - 1 : size;
+        
+        // get rid of beginning whitepace
+        parse_trim_front:
+        if (start < end) switch (code[start]) {
+            case ' ': case '\t': case '\r':
+                start++;
+                goto parse_trim_front;
+            default:
+                break;
+        }
+
+        // only show a window around the error of very long lines
+        const char* prefix = "";
+        const char* suffix = "";
+        if (start + ErrorContext < offset) {
+            start = offset - ErrorContext;
+            prefix = "...";
+        }
+        if (offset + ErrorContext < end) {
+            end = offset + ErrorContext;
+            suffix = "...";
+        }
+
+        // create error text
+        std::string err = sformat("Error in %s:%lu:%lu:\n%s%.*s%s\n  > %s\n",
+            lexer.file.c_str(), line, offset - starts[line - 1] + 1,
+            prefix, (int)(end - start), code + start, suffix,
+            sformat(format, args...).c_str());
+        
+        // return parser error object
+        return ParserError(err);
+    }
+};
+
+////////////////////////////////////////////////////////
+
+// bump allocator owning every node of a compilation, nodes are
+// never destroyed individually and release() drops them all at once
+class Arena {
+private:
+    struct Chunk;
+    Chunk* head = nullptr;
+    Chunk* current = nullptr;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    std::size_t chunk_size;
+
+    void* grow(std::size_t size, std::size_t align);
+
+public:
+    Arena(std::size_t _chunk_size = 64 * 1024) : chunk_size(_chunk_size) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena();
+
+    void release();
+    StrView copy(const StrView& str);
+
+    // bytes handed out since the last release
+    std::size_t used() const;
+
+    inline void* alloc(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+        char* ptr = reinterpret_cast<char*>(
+            (reinterpret_cast<std::uintptr_t>(cursor) + align - 1) & ~(align - 1));
+        if (!cursor || ptr + size > limit)
+            return grow(size, align);
+        cursor = ptr + size;
+        return ptr;
+    }
+
+    template <typename T, typename ...Args>
+    inline T* make(Args&&... args) {
+        return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+};
+
+// std allocator handing out arena memory, deallocation is a no-op
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    Arena* arena;
+
+    ArenaAllocator(Arena& _arena) : arena(&_arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    inline T* allocate(std::size_t count) {
+        return static_cast<T*>(arena->alloc(count * sizeof(T), alignof(T)));
+    }
+
+    inline void deallocate(T*, std::size_t) {}
+
+    template <typename U>
+    inline bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    inline bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
+    }
+};
+
+template <typename T>
+using ArenaVec = std::vector<T, ArenaAllocator<T>>;
+
+// interned string id, 0 is always the empty string
+typedef std::uint32_t Symbol;
+
+// unused slot of the symbol hash table
+#define SymbolNone 0xFFFFFFFFu
+
+// Per compilation table mapping identifiers and string literals to
+// symbols. Each distinct string is copied once into the table's own
+// arena, so equal names share memory and compare as integers.
+class Interner {
+private:
+    // hash kept next to the symbol so probes rarely touch the strings
+    struct Slot {
+        std::uint32_t hash;
+        Symbol symbol;
+    };
+
+    Arena storage;
+    std::vector<Slot> table;
+    std::vector<StrView> strings;
+    std::string scratch;
+
+    void grow();
+
+public:
+    Interner();
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    void clear();
+    Symbol intern(const StrView& str);
+    Symbol concat(const StrView& left, const StrView& right);
+    Symbol concat(const StrView* parts, std::size_t count);
+    static std::uint32_t hash(const StrView& str);
+
+    inline const StrView& str(Symbol symbol) const {
+        return strings[symbol];
+    }
+
+    inline std::size_t size() const {
+        return strings.size();
+    }
+};
+
+////////////////////////////////////////////////////////
+
+typedef enum {
+    EUnop     = 0,
+    EBinop    = 1,
+    EConst    = 2,
+    ECall     = 3,
+    EFunction = 4,
+    EReturn   = 5,
+    EBlock    = 6,
+    EIf       = 7,
+    ESwitch   = 8,
+    ECase     = 9,
+    ECaseCond = 10,
+    EAssign   = 11
+} ExprType;
+
+#define ExprPtr Expr*
+class Expr {
+public:
+    Token token;
+    ExprType type;
+
+    static const char* type_str(ExprType);
+
+    Expr(ExprType _type, const Token& _token)
+        : token(_token), type(_type) {}
+
+    template <typename T>
+    inline T* as() {
+        return reinterpret_cast<T*>(this);
+    }
+
+    inline bool is(ExprType t) const {
+        return type == t;
+    }
+
+    inline ExprPtr ptr() {
+        return this;
+    }
+
+    virtual void print() const = 0;
+};
+
+typedef enum {
+    EConstInt    = 0,
+    EConstFloat  = 1,
+    EConstString = 2,
+    EConstIdent  = 3,
+    EConstNull   = 4,
+    EConstThis   = 5
+} ConstExprType;
+
+class Const : public Expr {
+public:
+    void print() const;
+    ConstExprType const_type;
+    Const(const Token& token, ConstExprType type)
+        : Expr(EConst, token), const_type(type) {}
+
+    static const char* type_str(ConstExprType type);
+};
+
+class ConstInt : public Const {
+public:
+    void print() const;
+    std::uint64_t value;
+    ConstInt(const Token& token, const std::uint64_t& _value)
+        : Const(token, EConstInt), value(_value) {}
+};
+
+class ConstFloat : public Const {
+public:
+    void print() const;
+    double value;
+    ConstFloat(const Token& token, const double& _value)
+        : Const(token, EConstFloat), value(_value) {}
+};
+
+class ConstString : public Const {
+public:
+    void print() const;
+    StrView value;
+    Symbol symbol;
+    ConstString(const Token& token, const StrView& _value, Symbol _symbol)
+        : Const(token, EConstString), value(_value), symbol(_symbol) {}
+};
+
+class Var : public Const {
+public:
+    struct Flag {
+        static constexpr int 
+            Ref = 1 << 1,
+            Const = 1 << 2,
+            Packed = 1 << 3,
+            // set on declarations by analysis
+            Captured = 1 << 4,  // used by a nested function
+            Escapes = 1 << 5,   // captured or aliased through ref, needs a box
+            Assigned = 1 << 6;  // target of an assignment after its declaration
+    };
+
+    void print() const;
+    int flags = 0;
+    StrView name;
+    Symbol symbol;
+    // declaring Var or Function, this for declarations, null when unresolved
+    Expr* decl = nullptr;
+    // lexical address, frames to walk up and slot in that frame
+    std::uint32_t depth = 0;
+    std::uint32_t slot = 0;
+    // literal a const declaration is bound to, set by the optimizer
+    Const* constant = nullptr;
+    // what the optimizer knows of the value of a declaration that never changes
+    int facts = 0;
+    Var(const Token& token, const int& _flags, const StrView& _name, Symbol _symbol)
+        : Const(token, EConstIdent), flags(_flags), name(_name), symbol(_symbol) {}
+};
+
+class Unop : public Expr {
+public:
+    void print() const;
+    OpKind op;
+    ExprPtr value;
+    Unop(const Token& token, OpKind _op, ExprPtr _value)
+        : Expr(EUnop, token), op(_op), value(_value) {}
+};
+
+class Binop : public Expr {
+public:
+    void print() const;
+    OpKind op;
+    ExprPtr left;
+    ExprPtr right;
+    Binop(const Token& token, OpKind _op, ExprPtr _left, ExprPtr _right)
+        : Expr(EBinop, token), op(_op), left(_left), right(_right) {}
+};
+
+class Return : public Expr {
+public:
+    void print() const;
+    ExprPtr value;
+    Return(const Token& token, ExprPtr _value)
+        : Expr(EReturn, token), value(_value) {}
+};
+
+class Call : public Expr {
+public:
+    void print() const;
+    StrView name;
+    Symbol symbol;
+    // declaring Var or Function of the callee, null when unresolved
+    Expr* decl = nullptr;
+    std::uint32_t depth = 0;
+    std::uint32_t slot = 0;
+    ArenaVec<ExprPtr> args;
+    Call(const Token& token, const StrView& _name, Symbol _symbol, Arena& arena)
+        : Expr(ECall, token), name(_name), symbol(_symbol), args(arena) {}
+};
+
+class Block : public Expr {
+public:
+    void print() const;
+    ArenaVec<ExprPtr> body;
+    Block(const Token& token, Arena& arena)
+        : Expr(EBlock, token), body(arena) {}
+};
+
+class Case;
+class Switch : public Expr {
+public:
+    void print() const;
+    ExprPtr value;
+    ArenaVec<Case*> cases;
+    Switch(const Token& token, ExprPtr _value, Arena& arena)
+        : Expr(ESwitch, token), value(_value), cases(arena) {}
+};
+
+class CaseCondition : public Expr {
+public:
+    void print() const;
+    ExprPtr value;
+    ExprPtr condition;
+    bool is_direct = true;
+    CaseCondition(const Token& token, ExprPtr _value, ExprPtr _condition)
+        : Expr(ECaseCond, token), value(_value), condition(_condition) {}
+};
+
+class Case : public Expr {
+public:
+    void print() const;
+    ExprPtr body;
+    CaseCondition* condition;
+    Case(const Token& token, ExprPtr _body, CaseCondition* _condition)
+        : Expr(ECase, token), body(_body), condition(_condition) {}
+};
+
+class Function : public Expr {
+public:
+    void print() const;
+    ExprPtr body;
+    StrView name;
+    Symbol symbol;
+    ArenaVec<Var*> args;
+    // declarations of enclosing frames used in the body, including
+    // the ones only needed to pass on to nested functions
+    ArenaVec<ExprPtr> captures;
+    // slot of a named function in the enclosing frame
+    std::uint32_t slot = 0;
+    // slots needed by the arguments and locals of one call
+    std::uint32_t frame_size = 0;
+    // a nested function reaches into the frame, so it may outlive the call
+    bool frame_captured = false;
+    Function(const Token& token, const StrView& _name, Symbol _symbol, Arena& arena)
+        : Expr(EFunction, token), name(_name), symbol(_symbol), args(arena), captures(arena) {}
+};
+
+class Assign : public Expr {
+public:
+    void print() const;
+    ExprPtr value;
+    ArenaVec<Var*> vars;
+    Assign(const Token& token, ExprPtr _value, Arena& arena)
+        : Expr(EAssign, token), value(_value), vars(arena) {}
+};
+
+class If : public Expr {
+public:
+    void print() const;
+    ExprPtr body;
+    ExprPtr else_body;
+    ExprPtr condition;
+    If(const Token& token, ExprPtr x, ExprPtr y, ExprPtr z)
+        : Expr(EIf, token), body(x), else_body(y), condition(z) {}
+};
+
+// tokens the parser can look past current, must be a power of 2
+#define ParserLookahead 4
+
+class Parser {
+private:
+    Lexer lexer;
+    Token peeks[ParserLookahead];
+    std::size_t peek_head = 0;
+    std::size_t peek_count = 0;
+    TokenBuffer tokens;
+    std::size_t position = 0;
+    Token consume_error(TokenType, const StrView&, bool, bool);
+
+public:
+    Token current;
+    Arena arena;
+    Interner symbols;
+    bool prelex = false;
+
+    Parser() {};
+    Token next();
+    const Token& peek(std::size_t n = 1);
+    ExprPtr parse(const Source& source);
+
+    Token consume(bool maybe = false);
+    Token consume(TokenType, bool maybe = false);
+    Token consume(KeywordKind, bool maybe = false);
+    Token consume(OpKind, bool maybe = false);
+
+    template <typename T, typename ...Args>
+    inline T* make(Args&&... args) {
+        return arena.make<T>(std::forward<Args>(args)...);
+    }
+
+    // interned text of an identifier or string token
+    inline const StrView& text(const Token& token) const {
+        return symbols.str(token.id);
+    }
+
+    template <typename ...Args>
+    void error(const Token& token, const std::string& format, Args... args) {
+        throw ParserError::from(lexer, token.start, format, args...);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "value.hh"
+
+#include <memory>
+
+// register operand meaning the value is not needed
+#define RegNone 0xFFFF
+
+// registers on the vm stack and call frames it can nest
+#define VMStack (1 << 20)
+#define VMMaxCalls (1 << 16)
+
+// Instruction set of the register vm. Each entry is the opcode and the
+// operator it applies, the list expands into the enum and into the
+// dispatch table of the vm loop so both always line up.
+//
+//   Move       R[a] = R[b]
+//   LoadK      R[a] = K[b]
+//   LoadNull   R[a] = null
+//   GetUp      R[a] = slot c of the frame b levels up
+//   SetUp      slot c of the frame b levels up = R[a]
+//   Add .. Ge  R[a] = R[b] op R[c]
+//   Neg        R[a] = -R[b]
+//   Jump       pc = target
+//   JumpIf     if R[a] is truthy, pc = target
+//   JumpIfNot  if R[a] is falsy, pc = target
+//   JumpTable  jump through dense table dispatch[b] indexed by int R[a]
+//   JumpSearch binary search the sorted int keys of dispatch[b] for R[a]
+//   JumpHash   look up string R[a] in the perfect hash of dispatch[b]
+//   Closure    R[a] = closure of protos[b] over the current frame
+//   Call       R[a] = R[b](R[b + 1] .. R[b + c])
+//   Print      print R[b] .. R[b + c - 1], R[a] = null
+//   Return     return R[a]
+//   Fail       stop with the error message in K[b]
+#define BytecodeOps(X)                     \
+    X(Move, OpNone)                        \
+    X(LoadK, OpNone)                       \
+    X(LoadNull, OpNone)                    \
+    X(GetUp, OpNone)                       \
+    X(SetUp, OpNone)                       \
+    X(Add, OpAdd)                          \
+    X(Sub, OpSub)                          \
+    X(Mul, OpMul)                          \
+    X(Div, OpDiv)                          \
+    X(Mod, OpMod)                          \
+    X(Shl, OpShl)                          \
+    X(Shr, OpShr)                          \
+    X(BitAnd, OpBitAnd)                    \
+    X(BitXor, OpBitXor)                    \
+    X(BitOr, OpBitOr)                      \
+    X(Eq, OpEq)                            \
+    X(Ne, OpNe)                            \
+    X(Lt, OpLt)                            \
+    X(Le, OpLe)                            \
+    X(Gt, OpGt)                            \
+    X(Ge, OpGe)                            \
+    X(Neg, OpNone)                         \
+    X(Jump, OpNone)                        \
+    X(JumpIf, OpNone)                      \
+    X(JumpIfNot, OpNone)                   \
+    X(JumpTable, OpNone)                   \
+    X(JumpSearch, OpNone)                  \
+    X(JumpHash, OpNone)                    \
+    X(Closure, OpNone)                     \
+    X(Call, OpNone)                        \
+    X(Print, OpNone)                       \
+    X(Return, OpNone)                      \
+    X(Fail, OpNone)
+
+#define bytecode_enum(name, op) Bc##name,
+typedef enum {
+    BytecodeOps(bytecode_enum)
+    BcCount
+} Opcode;
+#undef bytecode_enum
+
+// fixed size instruction, jumps keep their target in b and c
+class Instr {
+public:
+    std::uint16_t op, a, b, c;
+
+    inline std::uint32_t target() const {
+        return std::uint32_t(b) | std::uint32_t(c) << 16;
+    }
+};
+
+// direct cases needed before a switch is lowered to a dispatch
+#define SwitchDispatchMin 4
+
+// lowered run of constant switch cases, every miss goes to fallback
+class Dispatch {
+public:
+    std::int64_t min = 0;
+    std::vector<std::int64_t> keys;
+    std::vector<const StrView*> strings;
+    std::vector<std::uint32_t> targets;
+    std::uint32_t fallback = 0;
+    std::uint32_t seed = 0;
+    std::uint32_t shift = 0;
+
+    // slot of a string in the perfect hash
+    inline std::size_t slot(std::uint32_t hash) const {
+        return std::uint32_t(hash * seed) >> shift;
+    }
+};
+
+// compiled body of a function or of the top level
+class Proto {
+public:
+    Function* function = nullptr;
+    std::vector<Instr> code;
+    std::vector<std::uint32_t> offsets;
+    std::vector<Value> constants;
+    std::vector<Proto*> protos;
+    std::vector<Dispatch> dispatch;
+    std::vector<std::uint16_t> params;
+    std::uint32_t registers = 0;
+    bool frame_captured = false;
+
+    static const char* op_str(Opcode op);
+    void print() const;
+};
+
+// every proto of a compiled tree, main runs the top level
+class Program {
+public:
+    std::vector<std::unique_ptr<Proto>> protos;
+    Proto* main = nullptr;
+
+    Proto* add();
+    void print() const;
+};
+
+// translate an analyzed tree into register bytecode, the resolver's
+// frame slots are used as registers and temporaries sit above them
+class Codegen {
+private:
+    Parser& parser;
+    Program* program = nullptr;
+    Proto* proto = nullptr;
+    std::uint32_t top = 0;
+    // operators of the left deep chains being compiled
+    std::vector<Binop*> spine;
+
+    std::uint16_t temp(const Token& token);
+    std::uint16_t constant(const Value& value, const Token& token);
+    std::uint32_t emit(Opcode op, const Token& token,
+        std::uint32_t a = 0, std::uint32_t b = 0, std::uint32_t c = 0);
+    std::uint32_t emit_jump(Opcode op, const Token& token, std::uint32_t a = 0);
+    void patch(std::uint32_t jump);
+    void fail(const Token& token, const std::string& message, std::uint16_t dest);
+
+    std::uint16_t expr(ExprPtr expr);
+    void into(ExprPtr expr, std::uint16_t dest);
+    void into_var(Var* var, std::uint16_t dest);
+    void into_binop(Binop* expr, std::uint16_t dest);
+    void into_call(Call* expr, std::uint16_t dest);
+    void into_switch(Switch* expr, std::uint16_t dest);
+    void into_case(Case* c, ExprPtr value_expr, std::uint16_t value, std::uint16_t dest,
+        std::vector<std::uint32_t>& ends);
+    bool into_dispatch(Switch* expr, std::size_t first, std::size_t last,
+        std::uint16_t value, std::uint16_t dest, std::vector<std::uint32_t>& ends);
+    void case_test(ExprPtr test, ExprPtr value_expr, std::uint16_t value,
+        std::vector<std::uint32_t>& matched);
+    Proto* function(Function* func);
+
+public:
+    Codegen(Parser& _parser) : parser(_parser) {}
+
+    // compile a tree whose top level needs frame_size slots
+    void compile(Program& program, ExprPtr tree, std::uint32_t frame_size);
+};
+
+// one active call of the vm
+class CallInfo {
+public:
+    const Proto* proto;
+    const Instr* pc;
+    Value* regs;
+    Value* stack_top;
+    Frame* frame;
+    Frame local;
+    std::uint16_t dest;
+
+    CallInfo() : local(nullptr, nullptr) {}
+};
+
+// register vm running a compiled program, dispatching with computed
+// goto under gcc and clang unless RATH_SWITCH_DISPATCH is defined
+class VM {
+private:
+    Parser& parser;
+    Arena heap;
+    std::vector<Value> stack;
+    std::vector<CallInfo> calls;
+
+    void error(const CallInfo* ci, const Instr* pc, const std::string& message);
+    Value arith(const CallInfo* ci, const Instr* pc, OpKind op,
+        const Value& left, const Value& right);
+
+public:
+    VM(Parser& _parser);
+    Value run(const Program& program);
+};
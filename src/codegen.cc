@@ -0,0 +1,745 @@
+#include "bytecode.hh"
+
+#include <algorithm>
+
+#define bytecode_name(name, op) #name,
+static const char* opcode_map[] = {
+    BytecodeOps(bytecode_name)
+};
+#undef bytecode_name
+
+const char* Proto::op_str(Opcode op) {
+    return opcode_map[op];
+}
+
+void Proto::print() const {
+    const StrView name = function ? function->name : StrView("main");
+    std::printf("proto %.*s: %u registers, %lu constants\n",
+        (int)name.size, name.data, registers, constants.size());
+
+    for (std::size_t i = 0; i < code.size(); i++) {
+        const Instr& instr = code[i];
+        std::printf("%5lu  %-10s", i, op_str(Opcode(instr.op)));
+        switch (instr.op) {
+            case BcJump:
+                std::printf(" -> %u\n", instr.target());
+                break;
+            case BcJumpIf:
+            case BcJumpIfNot:
+                std::printf(" %u -> %u\n", instr.a, instr.target());
+                break;
+            case BcJumpTable:
+            case BcJumpSearch:
+            case BcJumpHash:
+                std::printf(" %u dispatch %u, %lu targets, fallback %u\n", instr.a, instr.b,
+                    dispatch[instr.b].targets.size(), dispatch[instr.b].fallback);
+                break;
+            case BcLoadK:
+                std::printf(" %u ", instr.a);
+                constants[instr.b].print();
+                std::printf("\n");
+                break;
+            default:
+                std::printf(" %u %u %u\n", instr.a, instr.b, instr.c);
+                break;
+        }
+    }
+}
+
+Proto* Program::add() {
+    protos.emplace_back(new Proto());
+    return protos.back().get();
+}
+
+void Program::print() const {
+    for (const std::unique_ptr<Proto>& proto : protos)
+        proto->print();
+}
+
+///////////////////////////////////////////////////////////////
+
+// register opcode of a binary operator, BcCount when there is none
+static inline Opcode binop_opcode(OpKind op) {
+#define bytecode_binop(name, kind) if (kind != OpNone && op == kind) return Bc##name;
+    BytecodeOps(bytecode_binop)
+#undef bytecode_binop
+    return BcCount;
+}
+
+// operator compiled to a single register instruction
+static inline bool is_chain_op(ExprPtr expr) {
+    if (!expr || !expr->is(EBinop))
+        return false;
+    switch (expr->as<Binop>()->op) {
+        case OpAnd: case OpOr: case OpAssign: case OpUpdate: case OpDot:
+            return false;
+        default:
+            return binop_opcode(expr->as<Binop>()->op) != BcCount;
+    }
+}
+
+// check if an expression can run without side effects, so locals
+// it reads do not have to be copied before it is evaluated
+static bool is_simple(ExprPtr expr) {
+    if (!expr) return true;
+    switch (expr->type) {
+        case EConst:
+            return true;
+        case EUnop:
+            return is_simple(expr->as<Unop>()->value);
+        case EBinop: {
+            Binop* e = expr->as<Binop>();
+            return e->op != OpAssign && e->op != OpUpdate
+                && is_simple(e->left) && is_simple(e->right);
+        }
+        default:
+            return false;
+    }
+}
+
+#define is_var(e) \
+    ((e) && (e)->is(EConst) && (e)->as<Const>()->const_type == EConstIdent)
+
+// pick a temporary when the value of an expression is not wanted
+#define sink(dest, token) \
+    if (dest == RegNone) dest = temp(token)
+
+std::uint16_t Codegen::temp(const Token& token) {
+    if (top >= RegNone)
+        parser.error(token, "Too many registers needed by function%s", "");
+    proto->registers = std::max(proto->registers, top + 1);
+    return std::uint16_t(top++);
+}
+
+std::uint16_t Codegen::constant(const Value& value, const Token& token) {
+    if (proto->constants.size() >= RegNone)
+        parser.error(token, "Too many constants in function%s", "");
+    proto->constants.push_back(value);
+    return std::uint16_t(proto->constants.size() - 1);
+}
+
+std::uint32_t Codegen::emit(Opcode op, const Token& token,
+    std::uint32_t a, std::uint32_t b, std::uint32_t c)
+{
+    Instr instr;
+    instr.op = op;
+    instr.a = std::uint16_t(a);
+    instr.b = std::uint16_t(b);
+    instr.c = std::uint16_t(c);
+    proto->code.push_back(instr);
+    proto->offsets.push_back(std::uint32_t(token.start));
+    return std::uint32_t(proto->code.size() - 1);
+}
+
+std::uint32_t Codegen::emit_jump(Opcode op, const Token& token, std::uint32_t a) {
+    return emit(op, token, a);
+}
+
+// point a jump at the next instruction
+void Codegen::patch(std::uint32_t jump) {
+    const std::uint32_t target = std::uint32_t(proto->code.size());
+    proto->code[jump].b = std::uint16_t(target & 0xFFFF);
+    proto->code[jump].c = std::uint16_t(target >> 16);
+}
+
+// errors the tree walker reports when reached are raised at run time too
+void Codegen::fail(const Token& token, const std::string& message, std::uint16_t dest) {
+    StrView* text = parser.make<StrView>(parser.arena.copy(StrView(message.data(), message.size())));
+    emit(BcFail, token, 0, constant(Value::of_string(text), token));
+    if (dest != RegNone)
+        emit(BcLoadNull, token, dest);
+}
+
+// register holding the value of an expression, locals are used in place
+std::uint16_t Codegen::expr(ExprPtr e) {
+    if (is_var(e)) {
+        Var* var = e->as<Var>();
+        if (var->decl && var->depth == 0)
+            return std::uint16_t(var->slot);
+    }
+
+    const std::uint16_t dest = temp(e ? e->token : Token());
+    into(e, dest);
+    return dest;
+}
+
+void Codegen::into_var(Var* var, std::uint16_t dest) {
+    if (!var->decl) {
+        fail(var->token, sformat("Undefined variable %.*s",
+            (int)var->name.size, var->name.data), dest);
+        return;
+    }
+
+    if (dest == RegNone)
+        return;
+    if (var->depth > 0)
+        emit(BcGetUp, var->token, dest, var->depth, var->slot);
+    else if (var->slot != dest)
+        emit(BcMove, var->token, dest, var->slot);
+}
+
+void Codegen::into_binop(Binop* e, std::uint16_t dest) {
+    switch (e->op) {
+
+        // short circuiting logic producing 0 or 1
+        case OpAnd:
+        case OpOr: {
+            sink(dest, e->token);
+            const std::uint32_t mark = top;
+            const Opcode skip = e->op == OpAnd ? BcJumpIfNot : BcJumpIf;
+            const std::uint32_t left = emit_jump(skip, e->token, expr(e->left));
+            top = mark;
+            const std::uint32_t right = emit_jump(skip, e->token, expr(e->right));
+            top = mark;
+            emit(BcLoadK, e->token, dest, constant(Value::of_bool(e->op == OpAnd), e->token));
+            const std::uint32_t end = emit_jump(BcJump, e->token);
+            patch(left);
+            patch(right);
+            emit(BcLoadK, e->token, dest, constant(Value::of_bool(e->op == OpOr), e->token));
+            patch(end);
+            return;
+        }
+
+        // store into the slot of a resolved variable
+        case OpAssign:
+        case OpUpdate: {
+            if (!is_var(e->left)) {
+                fail(e->token, "Invalid assignment target", dest);
+                return;
+            }
+            Var* var = e->left->as<Var>();
+            if (!var->decl) {
+                fail(var->token, sformat("Undefined variable %.*s",
+                    (int)var->name.size, var->name.data), dest);
+                return;
+            }
+            if (var->decl->is(EConst) && (var->decl->as<Var>()->flags & Var::Flag::Const)) {
+                fail(var->token, sformat("Cannot assign to const %.*s",
+                    (int)var->name.size, var->name.data), dest);
+                return;
+            }
+
+            if (var->depth == 0) {
+                into(e->right, std::uint16_t(var->slot));
+                if (dest != RegNone && dest != var->slot)
+                    emit(BcMove, e->token, dest, var->slot);
+            } else {
+                const std::uint32_t mark = top;
+                const std::uint16_t value = expr(e->right);
+                emit(BcSetUp, e->token, value, var->depth, var->slot);
+                if (dest != RegNone)
+                    emit(BcMove, e->token, dest, value);
+                top = mark;
+            }
+            return;
+        }
+
+        case OpDot:
+            fail(e->token, "Member access is not supported", dest);
+            return;
+
+        // Left deep chains like a + b + c are compiled along their spine,
+        // every operator but the last one leaving its result in the same
+        // temporary, so their length costs neither native stack nor registers.
+        default: {
+            if (binop_opcode(e->op) == BcCount) {
+                fail(e->token, sformat("Invalid operator %s", Token::op_str(e->op)), dest);
+                return;
+            }
+
+            sink(dest, e->token);
+            const std::uint32_t mark = top;
+            const std::size_t first = spine.size();
+            for (ExprPtr link = e; is_chain_op(link); link = link->as<Binop>()->left)
+                spine.push_back(link->as<Binop>());
+
+            const std::uint16_t result = spine.size() - first > 1 ? temp(e->token) : dest;
+            const std::uint32_t base = top;
+
+            Binop* inner = spine.back();
+            std::uint16_t left;
+            if (is_simple(inner->right)) {
+                left = expr(inner->left);
+            } else {
+                // the right side may change a local read on the left
+                left = temp(inner->token);
+                into(inner->left, left);
+            }
+
+            for (std::size_t i = spine.size(); i > first; i--) {
+                Binop* link = spine[i - 1];
+                const std::uint16_t right = expr(link->right);
+                const std::uint16_t out = i - 1 == first ? dest : result;
+                emit(binop_opcode(link->op), link->token, out, left, right);
+                left = out;
+                top = base;
+            }
+            spine.resize(first);
+            top = mark;
+            return;
+        }
+    }
+}
+
+void Codegen::into_call(Call* e, std::uint16_t dest) {
+    if (e->args.size() >= RegNone)
+        parser.error(e->token, "Too many arguments%s", "");
+    const std::uint32_t mark = top;
+
+    // builtins
+    if (!e->decl) {
+        if (e->name != StrView("print")) {
+            fail(e->token, sformat("Undefined function %.*s",
+                (int)e->name.size, e->name.data), dest);
+            return;
+        }
+
+        const std::uint16_t base = std::uint16_t(top);
+        for (std::size_t i = 0; i < e->args.size(); i++)
+            temp(e->token);
+        for (std::size_t i = 0; i < e->args.size(); i++)
+            into(e->args[i], std::uint16_t(base + i));
+        emit(BcPrint, e->token, dest == RegNone ? base : dest, base, e->args.size());
+        top = mark;
+        return;
+    }
+
+    // callee and arguments go into consecutive registers
+    sink(dest, e->token);
+    const std::uint16_t base = temp(e->token);
+    for (std::size_t i = 0; i < e->args.size(); i++)
+        temp(e->token);
+
+    if (e->depth > 0)
+        emit(BcGetUp, e->token, base, e->depth, e->slot);
+    else
+        emit(BcMove, e->token, base, e->slot);
+    for (std::size_t i = 0; i < e->args.size(); i++)
+        into(e->args[i], std::uint16_t(base + 1 + i));
+
+    emit(BcCall, e->token, dest, base, e->args.size());
+    top = mark;
+}
+
+// Direct cases are an || chain of `value == x` tests on the switch
+// value, each one jumps to the case body once it matches.
+void Codegen::case_test(ExprPtr test, ExprPtr value_expr, std::uint16_t value,
+    std::vector<std::uint32_t>& matched)
+{
+    if (!test) return;
+    const std::uint32_t mark = top;
+
+    if (test->is(EBinop)) {
+        Binop* op = test->as<Binop>();
+        if (op->op == OpOr) {
+            case_test(op->left, value_expr, value, matched);
+            case_test(op->right, value_expr, value, matched);
+            return;
+        }
+        if (op->op == OpEq && op->left == value_expr) {
+            const std::uint16_t result = temp(op->token);
+            emit(BcEq, op->token, result, value, expr(op->right));
+            matched.push_back(emit_jump(BcJumpIf, op->token, result));
+            top = mark;
+            return;
+        }
+    }
+
+    matched.push_back(emit_jump(BcJumpIf, test->token, expr(test)));
+    top = mark;
+}
+
+void Codegen::into_case(Case* c, ExprPtr value_expr, std::uint16_t value, std::uint16_t dest,
+    std::vector<std::uint32_t>& ends)
+{
+    CaseCondition* cond = c->condition;
+    std::vector<std::uint32_t> next;
+
+    // `case n when ...` binds the value before testing
+    if (!cond->is_direct) {
+        const std::uint32_t mark = top;
+        ExprPtr pattern = cond->value;
+        if (is_var(pattern)) {
+            emit(BcMove, cond->token, pattern->as<Var>()->slot, value);
+        } else if (pattern) {
+            const std::uint16_t result = temp(cond->token);
+            emit(BcEq, cond->token, result, value, expr(pattern));
+            next.push_back(emit_jump(BcJumpIfNot, cond->token, result));
+        }
+        top = mark;
+        if (cond->condition)
+            next.push_back(emit_jump(BcJumpIfNot, cond->token, expr(cond->condition)));
+        else
+            next.push_back(emit_jump(BcJump, cond->token));
+        top = mark;
+    } else {
+        std::vector<std::uint32_t> matched;
+        case_test(cond->condition, value_expr, value, matched);
+        next.push_back(emit_jump(BcJump, cond->token));
+        for (std::uint32_t jump : matched)
+            patch(jump);
+    }
+
+    if (c->body)
+        into(c->body, dest);
+    else
+        emit(BcLoadNull, c->token, dest);
+    ends.push_back(emit_jump(BcJump, c->token));
+    for (std::uint32_t jump : next)
+        patch(jump);
+}
+
+// Collect the constants a direct case compares the switch value against,
+// false when any test is not `value == constant` of the given kind.
+static bool case_keys(ExprPtr test, ExprPtr value_expr, ConstExprType& kind,
+    std::vector<Const*>& keys)
+{
+    if (!test || !test->is(EBinop))
+        return false;
+
+    Binop* op = test->as<Binop>();
+    if (op->op == OpOr)
+        return case_keys(op->left, value_expr, kind, keys)
+            && case_keys(op->right, value_expr, kind, keys);
+    if (op->op != OpEq || op->left != value_expr || !op->right || !op->right->is(EConst))
+        return false;
+
+    Const* key = op->right->as<Const>();
+    if (key->const_type != EConstInt && key->const_type != EConstString)
+        return false;
+    if (kind != EConstNull && kind != key->const_type)
+        return false;
+    kind = key->const_type;
+    keys.push_back(key);
+    return true;
+}
+
+// Lower the direct cases [first, last) that compare against constants of
+// one kind: dense ints become a jump table, sparse ones a binary search
+// and strings a perfect hash. The first case naming a key wins, like the
+// sequential tests it replaces.
+bool Codegen::into_dispatch(Switch* e, std::size_t first, std::size_t last,
+    std::uint16_t value, std::uint16_t dest, std::vector<std::uint32_t>& ends)
+{
+    ConstExprType kind = EConstNull;
+    std::vector<Const*> keys;
+    std::vector<std::size_t> owners;
+    for (std::size_t i = first; i < last; i++) {
+        case_keys(e->cases[i]->condition->condition, e->value, kind, keys);
+        owners.resize(keys.size(), i - first);
+    }
+
+    Dispatch table;
+    Opcode op;
+    std::vector<std::pair<std::int64_t, std::size_t>> ints;
+    std::vector<std::pair<const StrView*, std::size_t>> strings;
+
+    if (kind == EConstInt) {
+        for (std::size_t i = 0; i < keys.size(); i++)
+            ints.emplace_back(std::int64_t(keys[i]->as<ConstInt>()->value), owners[i]);
+        std::stable_sort(ints.begin(), ints.end(),
+            [](const std::pair<std::int64_t, std::size_t>& a,
+               const std::pair<std::int64_t, std::size_t>& b) { return a.first < b.first; });
+        ints.erase(std::unique(ints.begin(), ints.end(),
+            [](const std::pair<std::int64_t, std::size_t>& a,
+               const std::pair<std::int64_t, std::size_t>& b) { return a.first == b.first; }),
+            ints.end());
+
+        // a table when at most half of it would be holes
+        const std::uint64_t range = std::uint64_t(ints.back().first) - std::uint64_t(ints.front().first);
+        if (range < 2 * ints.size()) {
+            op = BcJumpTable;
+            table.min = ints.front().first;
+            table.targets.resize(range + 1);
+        } else {
+            op = BcJumpSearch;
+            for (const std::pair<std::int64_t, std::size_t>& key : ints)
+                table.keys.push_back(key.first);
+            table.targets.resize(ints.size());
+        }
+    } else {
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            const StrView* key = &keys[i]->as<ConstString>()->value;
+            bool seen = false;
+            for (const std::pair<const StrView*, std::size_t>& other : strings)
+                seen = seen || *other.first == *key;
+            if (!seen)
+                strings.emplace_back(key, owners[i]);
+        }
+
+        // grow the table until some multiplier places every key apart
+        std::vector<std::uint32_t> hashes;
+        for (const std::pair<const StrView*, std::size_t>& key : strings)
+            hashes.push_back(Interner::hash(*key.first));
+
+        std::uint32_t bits = 1;
+        while ((std::size_t(1) << bits) < 2 * strings.size())
+            bits++;
+        for (const std::uint32_t limit = bits + 4; table.seed == 0 && bits <= limit; bits++) {
+            table.shift = 32 - bits;
+            for (std::uint32_t attempt = 0; attempt < 64; attempt++) {
+                table.seed = (0x9e3779b9u + attempt * 0x6d2b79f6u) | 1;
+                std::vector<bool> used(std::size_t(1) << bits);
+                for (std::uint32_t hash : hashes) {
+                    const std::size_t slot = table.slot(hash);
+                    if (used[slot]) { table.seed = 0; break; }
+                    used[slot] = true;
+                }
+                if (table.seed) break;
+            }
+        }
+        if (table.seed == 0)
+            return false;
+
+        op = BcJumpHash;
+        table.strings.resize(std::size_t(1) << (32 - table.shift));
+        table.targets.resize(table.strings.size());
+    }
+
+    const std::uint32_t index = std::uint32_t(proto->dispatch.size());
+    proto->dispatch.push_back(table);
+    emit(op, e->cases[first]->token, value, index);
+
+    // bodies follow the dispatch in case order
+    std::vector<std::uint32_t> bodies;
+    for (std::size_t i = first; i < last; i++) {
+        Case* c = e->cases[i];
+        bodies.push_back(std::uint32_t(proto->code.size()));
+        if (c->body)
+            into(c->body, dest);
+        else
+            emit(BcLoadNull, c->token, dest);
+        ends.push_back(emit_jump(BcJump, c->token));
+    }
+
+    Dispatch& lowered = proto->dispatch[index];
+    lowered.fallback = std::uint32_t(proto->code.size());
+    std::fill(lowered.targets.begin(), lowered.targets.end(), lowered.fallback);
+    if (op == BcJumpTable) {
+        for (const std::pair<std::int64_t, std::size_t>& key : ints)
+            lowered.targets[std::uint64_t(key.first) - std::uint64_t(lowered.min)] = bodies[key.second];
+    } else if (op == BcJumpSearch) {
+        for (std::size_t i = 0; i < ints.size(); i++)
+            lowered.targets[i] = bodies[ints[i].second];
+    } else {
+        for (const std::pair<const StrView*, std::size_t>& key : strings) {
+            const std::size_t slot = lowered.slot(Interner::hash(*key.first));
+            lowered.strings[slot] = key.first;
+            lowered.targets[slot] = bodies[key.second];
+        }
+    }
+    return true;
+}
+
+void Codegen::into_switch(Switch* e, std::uint16_t dest) {
+    sink(dest, e->token);
+    const std::uint32_t mark = top;
+    const std::uint16_t value = temp(e->token);
+    into(e->value, value);
+
+    std::vector<std::uint32_t> ends;
+    for (std::size_t i = 0; i < e->cases.size();) {
+
+        // find the run of direct constant cases starting here
+        ConstExprType kind = EConstNull;
+        std::vector<Const*> keys;
+        std::size_t last = i;
+        while (last < e->cases.size()) {
+            CaseCondition* cond = e->cases[last]->condition;
+            const std::size_t count = keys.size();
+            if (!cond->is_direct || !case_keys(cond->condition, e->value, kind, keys)) {
+                keys.resize(count);
+                break;
+            }
+            last++;
+        }
+
+        if (keys.size() >= SwitchDispatchMin && into_dispatch(e, i, last, value, dest, ends)) {
+            i = last;
+            continue;
+        }
+        into_case(e->cases[i], e->value, value, dest, ends);
+        i++;
+    }
+
+    emit(BcLoadNull, e->token, dest);
+    for (std::uint32_t jump : ends)
+        patch(jump);
+    top = mark;
+}
+
+void Codegen::into(ExprPtr e, std::uint16_t dest) {
+    if (!e) {
+        if (dest != RegNone)
+            emit(BcLoadNull, Token(), dest);
+        return;
+    }
+
+    switch (e->type) {
+
+        case EConst: {
+            Const* c = e->as<Const>();
+            if (c->const_type == EConstIdent) {
+                into_var(c->as<Var>(), dest);
+                return;
+            }
+            if (dest == RegNone)
+                return;
+            switch (c->const_type) {
+                case EConstInt:
+                    emit(BcLoadK, e->token, dest, constant(
+                        Value::of_int(std::int64_t(c->as<ConstInt>()->value), parser.arena), e->token));
+                    break;
+                case EConstFloat:
+                    emit(BcLoadK, e->token, dest, constant(
+                        Value::of_float(c->as<ConstFloat>()->value), e->token));
+                    break;
+                case EConstString:
+                    emit(BcLoadK, e->token, dest, constant(
+                        Value::of_string(&c->as<ConstString>()->value), e->token));
+                    break;
+                default:
+                    emit(BcLoadNull, e->token, dest);
+                    break;
+            }
+            return;
+        }
+
+        case EUnop: {
+            Unop* u = e->as<Unop>();
+            if (u->op != OpSub) {
+                into(u->value, dest);
+                return;
+            }
+            sink(dest, e->token);
+            const std::uint32_t mark = top;
+            emit(BcNeg, e->token, dest, expr(u->value));
+            top = mark;
+            return;
+        }
+
+        case EBinop:
+            into_binop(e->as<Binop>(), dest);
+            return;
+
+        case EReturn: {
+            const std::uint32_t mark = top;
+            emit(BcReturn, e->token, expr(e->as<Return>()->value));
+            top = mark;
+            return;
+        }
+
+        case ECall:
+            into_call(e->as<Call>(), dest);
+            return;
+
+        case EBlock: {
+            ArenaVec<ExprPtr>& body = e->as<Block>()->body;
+            std::size_t last = body.size();
+            while (last > 0 && !body[last - 1])
+                last--;
+            if (last == 0 && dest != RegNone)
+                emit(BcLoadNull, e->token, dest);
+            for (std::size_t i = 0; i < last; i++)
+                if (body[i])
+                    into(body[i], i + 1 == last ? dest : std::uint16_t(RegNone));
+            return;
+        }
+
+        case EIf: {
+            If* f = e->as<If>();
+            const std::uint32_t mark = top;
+            const std::uint32_t skip = emit_jump(BcJumpIfNot, e->token, expr(f->condition));
+            top = mark;
+            into(f->body, dest);
+            if (!f->else_body && dest == RegNone) {
+                patch(skip);
+                return;
+            }
+            const std::uint32_t end = emit_jump(BcJump, e->token);
+            patch(skip);
+            into(f->else_body, dest);
+            patch(end);
+            return;
+        }
+
+        case ESwitch:
+            into_switch(e->as<Switch>(), dest);
+            return;
+
+        // a named function is stored in its slot when created
+        case EFunction: {
+            Function* f = e->as<Function>();
+            if (proto->protos.size() >= RegNone)
+                parser.error(e->token, "Too many functions in function%s", "");
+            proto->protos.push_back(function(f));
+            const std::uint32_t index = std::uint32_t(proto->protos.size() - 1);
+
+            if (f->name.size > 0) {
+                emit(BcClosure, e->token, f->slot, index);
+                if (dest != RegNone && dest != f->slot)
+                    emit(BcMove, e->token, dest, f->slot);
+            } else {
+                sink(dest, e->token);
+                emit(BcClosure, e->token, dest, index);
+            }
+            return;
+        }
+
+        case EAssign: {
+            Assign* a = e->as<Assign>();
+            if (a->vars.empty()) {
+                into(a->value, dest);
+                return;
+            }
+            const std::uint16_t first = std::uint16_t(a->vars[0]->slot);
+            into(a->value, first);
+            for (std::size_t i = 1; i < a->vars.size(); i++)
+                emit(BcMove, e->token, a->vars[i]->slot, first);
+            if (dest != RegNone && dest != first)
+                emit(BcMove, e->token, dest, first);
+            return;
+        }
+
+        default:
+            fail(e->token, sformat("Cannot evaluate %s", Expr::type_str(e->type)), dest);
+            return;
+    }
+}
+
+Proto* Codegen::function(Function* func) {
+    if (func->frame_size >= RegNone)
+        parser.error(func->token, "Too many locals in function%s", "");
+
+    Proto* saved = proto;
+    const std::uint32_t saved_top = top;
+
+    proto = program->add();
+    proto->function = func;
+    proto->frame_captured = func->frame_captured;
+    proto->registers = func->frame_size;
+    for (Var* arg : func->args)
+        proto->params.push_back(std::uint16_t(arg->slot));
+
+    top = func->frame_size;
+    emit(BcReturn, func->token, expr(func->body));
+
+    Proto* result = proto;
+    proto = saved;
+    top = saved_top;
+    return result;
+}
+
+void Codegen::compile(Program& _program, ExprPtr tree, std::uint32_t frame_size) {
+    if (frame_size >= RegNone)
+        parser.error(tree ? tree->token : Token(), "Too many top level locals%s", "");
+
+    program = &_program;
+    program->protos.clear();
+    proto = program->main = program->add();
+    proto->registers = frame_size;
+    proto->frame_captured = true;
+
+    top = frame_size;
+    emit(BcReturn, tree ? tree->token : Token(), expr(tree));
+}
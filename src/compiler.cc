@@ -1,21 +1,56 @@
 #include "compiler.hh"
 
-int Compiler::compile(const std::string& code) {
+ExprPtr Compiler::parse(const Source& source) {
+    parser.prelex = options.prelex;
+    return parser.parse(source);
+}
+
+Value Compiler::execute(ExprPtr tree) {
+    if (!options.vm) {
+        Interpreter interpreter(parser);
+        return interpreter.run(tree, frame_size);
+    }
+
+    Program program;
+    Codegen(parser).compile(program, tree, frame_size);
+    return VM(parser).run(program);
+}
+
+int Compiler::compile(const Source& source) {
+    int status = 0;
+
     try {
-        ExprPtr tree = parser.parse("test.rath", code);
-        if (!analyze(&tree)) return 1;
+        if (!options.passes.empty())
+            optimizer.select(options.passes);
+        optimizer.timing = options.pass_stats;
+        ExprPtr tree = parse(source);
 
-        if (tree) {
+        if (options.flat) {
+            optimize(flat.build(tree)).print();
+            if (flat.root != FlatNull)
+                std::printf("\n");
+        }
+        else if (!analyze(&tree))
+            status = 1;
+        else if (options.run)
+            execute(tree);
+        else if (options.bytecode) {
+            Program program;
+            Codegen(parser).compile(program, tree, frame_size);
+            program.print();
+        }
+        else if (tree) {
             tree->print();
             std::printf("\n");
         }
 
-        delete tree;
-
     } catch (const std::exception& err) {
         std::fprintf(stderr, "%s\n", err.what());
-        return 1;
+        status = 1;
     }
 
-    return 0;
-}
\ No newline at end of file
+    // every node lives in the arena, drop the whole tree at once
+    parser.arena.release();
+    parser.symbols.clear();
+    return status;
+}
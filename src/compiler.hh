@@ -1,17 +1,50 @@
 #pragma once
 
-#include "ast.hh"
+#include "flat.hh"
+#include "optimize.hh"
+#include "interpreter.hh"
+#include "bytecode.hh"
+
+// settings selected by the driver
+class Options {
+public:
+    bool prelex = false;
+    bool flat = false;
+    bool run = false;
+    bool vm = false;
+    bool bytecode = false;
+    bool pass_stats = false;
+    std::string passes;
+};
 
 class Compiler {
 private:
     Parser parser;
+    FlatAst flat;
 
 public:
+    Options options;
+    Optimizer optimizer { parser };
+
+    // slots needed by the top level locals of the last analyzed tree
+    std::uint32_t frame_size = 0;
+
     Compiler() = default;
 
+    ExprPtr parse(const Source& source);
+
+    // bytes of tree nodes allocated since the last compile
+    inline std::size_t arena_used() const {
+        return parser.arena.used();
+    }
+
     ExprPtr optimize(ExprPtr tree);
+    FlatAst& optimize(FlatAst& ast);
 
     bool analyze(ExprPtr* tree);
 
-    int compile(const std::string& code);
-};
\ No newline at end of file
+    // run an analyzed tree with the engine selected in options
+    Value execute(ExprPtr tree);
+
+    int compile(const Source& source);
+};
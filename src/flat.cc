@@ -0,0 +1,314 @@
+#include "flat.hh"
+
+void FlatAst::clear() {
+    nodes.clear();
+    extra.clear();
+    ints.clear();
+    floats.clear();
+    strings.clear();
+    root = FlatNull;
+}
+
+FlatAst& FlatAst::build(ExprPtr tree) {
+    clear();
+    root = tree ? add(tree) : FlatNull;
+    return *this;
+}
+
+std::size_t FlatAst::bytes() const {
+    return nodes.size() * sizeof(FlatNode)
+        + extra.size() * sizeof(std::uint32_t)
+        + ints.size() * sizeof(std::uint64_t)
+        + floats.size() * sizeof(double)
+        + strings.size() * sizeof(StrView);
+}
+
+std::uint32_t FlatAst::add_node(ExprPtr expr, std::uint8_t kind,
+    std::uint32_t a, std::uint32_t b, std::uint32_t c)
+{
+    FlatNode node;
+    node.type = expr->type;
+    node.kind = kind;
+    node.flags = 0;
+    node.start = std::uint32_t(expr->token.start);
+    node.a = a;
+    node.b = b;
+    node.c = c;
+    nodes.push_back(node);
+    return std::uint32_t(nodes.size() - 1);
+}
+
+std::uint32_t FlatAst::add_string(const StrView& str) {
+    strings.push_back(str);
+    return std::uint32_t(strings.size() - 1);
+}
+
+// convert every child first, then store their indices as one range
+template <typename T>
+std::uint32_t FlatAst::add_list(const ArenaVec<T>& list, std::uint32_t& count) {
+    std::vector<std::uint32_t> children;
+    children.reserve(list.size());
+    for (T expr : list)
+        children.push_back(expr ? add(expr) : FlatNull);
+
+    const std::uint32_t start = std::uint32_t(extra.size());
+    extra.insert(extra.end(), children.begin(), children.end());
+    count = std::uint32_t(children.size());
+    return start;
+}
+
+#define add_child(e) ((e) ? add(e) : FlatNull)
+
+std::uint32_t FlatAst::add(ExprPtr expr) {
+    std::uint32_t a, b, count;
+    switch (expr->type) {
+
+        case EConst: {
+            Const* e = expr->as<Const>();
+            switch (e->const_type) {
+                case EConstInt:
+                    ints.push_back(e->as<ConstInt>()->value);
+                    return add_node(e, e->const_type, std::uint32_t(ints.size() - 1));
+                case EConstFloat:
+                    floats.push_back(e->as<ConstFloat>()->value);
+                    return add_node(e, e->const_type, std::uint32_t(floats.size() - 1));
+                case EConstString:
+                    return add_node(e, e->const_type, add_string(e->as<ConstString>()->value));
+                case EConstIdent: {
+                    Var* var = e->as<Var>();
+                    a = add_node(e, e->const_type, add_string(var->name));
+                    nodes[a].flags = std::uint16_t(var->flags);
+                    return a;
+                }
+                default:
+                    return add_node(e, e->const_type, FlatNull);
+            }
+        }
+
+        case EUnop: {
+            Unop* e = expr->as<Unop>();
+            a = add_child(e->value);
+            return add_node(e, e->op, a);
+        }
+
+        // left deep chains like a + b + c are walked along their spine,
+        // still storing every operand before the operator using it
+        case EBinop: {
+            const std::size_t mark = spine.size();
+            for (ExprPtr link = expr; link && link->is(EBinop); link = link->as<Binop>()->left)
+                spine.push_back(link->as<Binop>());
+            a = add_child(spine.back()->left);
+            for (std::size_t i = spine.size(); i > mark; i--) {
+                Binop* e = spine[i - 1];
+                b = add_child(e->right);
+                a = add_node(e, e->op, a, b);
+            }
+            spine.resize(mark);
+            return a;
+        }
+
+        case EReturn: {
+            a = add_child(expr->as<Return>()->value);
+            return add_node(expr, 0, a);
+        }
+
+        case ECall: {
+            Call* e = expr->as<Call>();
+            b = add_list(e->args, count);
+            return add_node(e, 0, add_string(e->name), b, count);
+        }
+
+        case EBlock: {
+            b = add_list(expr->as<Block>()->body, count);
+            return add_node(expr, 0, FlatNull, b, count);
+        }
+
+        case ESwitch: {
+            Switch* e = expr->as<Switch>();
+            a = add_child(e->value);
+            b = add_list(e->cases, count);
+            return add_node(e, 0, a, b, count);
+        }
+
+        case ECaseCond: {
+            CaseCondition* e = expr->as<CaseCondition>();
+            a = add_child(e->value);
+            b = add_child(e->condition);
+            a = add_node(e, 0, a, b);
+            nodes[a].flags = e->is_direct;
+            return a;
+        }
+
+        case ECase: {
+            Case* e = expr->as<Case>();
+            a = add_child(e->body);
+            b = add_child(e->condition);
+            return add_node(e, 0, a, b);
+        }
+
+        case EFunction: {
+            Function* e = expr->as<Function>();
+            a = add_child(e->body);
+            std::vector<std::uint32_t> args;
+            for (Var* arg : e->args)
+                args.push_back(add(arg));
+            b = std::uint32_t(extra.size());
+            extra.push_back(add_string(e->name));
+            extra.insert(extra.end(), args.begin(), args.end());
+            return add_node(e, 0, a, b, std::uint32_t(args.size()));
+        }
+
+        case EAssign: {
+            Assign* e = expr->as<Assign>();
+            a = add_child(e->value);
+            b = add_list(e->vars, count);
+            return add_node(e, 0, a, b, count);
+        }
+
+        case EIf: {
+            If* e = expr->as<If>();
+            a = add_child(e->condition);
+            b = add_child(e->body);
+            std::uint32_t c = add_child(e->else_body);
+            return add_node(e, 0, a, b, c);
+        }
+
+        default:
+            return FlatNull;
+    }
+}
+
+#undef add_child
+
+///////////////////////////////////////////////////////////////
+
+// print a child or a placeholder for missing ones
+#define print_or(node, text) \
+    if ((node) != FlatNull) print(node); else std::printf(text)
+
+// print a range of extra as a comma separated list
+#define print_range(start, count)                    \
+    for (std::uint32_t i = 0; i < (count); i++) {    \
+        print(extra[(start) + i]);                   \
+        if (i + 1 < (count)) std::printf(", ");      \
+    }
+
+void FlatAst::print(std::uint32_t index) const {
+    if (index == FlatNull) return;
+    const FlatNode& node = nodes[index];
+
+    switch (node.type) {
+
+        case EConst: {
+            const char* name = Const::type_str(ConstExprType(node.kind));
+            switch (node.kind) {
+                case EConstInt:
+                    std::printf("[%s %ld]", name, std::int64_t(ints[node.a]));
+                    break;
+                case EConstFloat:
+                    std::printf("[%s %g]", name, floats[node.a]);
+                    break;
+                case EConstString:
+                    std::printf("[%s \"%.*s\"]", name,
+                        (int)strings[node.a].size, strings[node.a].data);
+                    break;
+                case EConstIdent:
+                    std::printf("[%s%s%s%s%.*s]", name,
+                        node.flags & Var::Flag::Const ? " const " : "",
+                        node.flags & Var::Flag::Ref ? " ref " : "",
+                        node.flags & Var::Flag::Const ? " ... " : " ",
+                        (int)strings[node.a].size, strings[node.a].data);
+                    break;
+                default:
+                    std::printf("[Const %s]", name);
+                    break;
+            }
+            break;
+        }
+
+        case EUnop:
+            std::printf("[Unop(%s) ", Token::op_str(OpKind(node.kind)));
+            print(node.a);
+            std::printf("]");
+            break;
+
+        case EBinop:
+            std::printf("[Binop(%s) ", Token::op_str(OpKind(node.kind)));
+            std::printf("left="); print_or(node.a, "null");
+            std::printf(" right="); print_or(node.b, "null");
+            std::printf("]");
+            break;
+
+        case EReturn:
+            std::printf("[Return ");
+            print(node.a);
+            std::printf("]");
+            break;
+
+        case ECall: {
+            const StrView& name = strings[node.a];
+            std::printf("[Call%s%.*s args={", name.size > 0 ? " " : "", (int)name.size, name.data);
+            print_range(node.b, node.c);
+            std::printf("}]");
+            break;
+        }
+
+        case EBlock:
+            std::printf("[Block body={");
+            print_range(node.b, node.c);
+            std::printf("}]");
+            break;
+
+        case ESwitch:
+            std::printf("[Switch cases={");
+            print_range(node.b, node.c);
+            std::printf("}]");
+            break;
+
+        case ECaseCond:
+            std::printf("[Cond ");
+            print(node.b);
+            std::printf("]");
+            break;
+
+        case ECase:
+            std::printf("[Case ");
+            print(node.b);
+            std::printf(" body="); print(node.a);
+            std::printf("]");
+            break;
+
+        case EFunction: {
+            const StrView& name = strings[extra[node.b]];
+            const char* space = name.size > 0 ? " " : "";
+            std::printf("[Func%s%.*s%sargs={", space, (int)name.size, name.data, space);
+            print_range(node.b + 1, node.c);
+            std::printf("} body=");
+            print_or(node.a, "null");
+            std::printf("]");
+            break;
+        }
+
+        case EAssign:
+            std::printf("[Assign vars={");
+            print_range(node.b, node.c);
+            std::printf("} value=");
+            print_or(node.a, "null");
+            std::printf("]");
+            break;
+
+        case EIf:
+            std::printf("[If ");
+            print_or(node.a, "null");
+            std::printf(" ");
+            print_or(node.b, "null");
+            std::printf(" Else ");
+            print_or(node.c, "null");
+            std::printf("]");
+            break;
+
+        default:
+            std::printf("[Expr]");
+            break;
+    }
+}
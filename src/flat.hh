@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ast.hh"
+
+// index of a missing child
+#define FlatNull 0xFFFFFFFFu
+
+// Node of the flat ast. Operands a, b, c are node indices, payload
+// indices or ranges of FlatAst::extra depending on the node type:
+//
+//   Const     kind = ConstExprType, a = index into ints / floats / strings
+//   Var       kind = EConstIdent, flags = Var flags, a = name in strings
+//   Unop      kind = OpKind, a = value
+//   Binop     kind = OpKind, a = left, b = right
+//   Return    a = value
+//   Call      a = name in strings, extra[b, b + c) = args
+//   Block     extra[b, b + c) = body
+//   Switch    a = value, extra[b, b + c) = cases
+//   CaseCond  flags = is_direct, a = value, b = condition
+//   Case      a = body, b = condition
+//   Function  a = body, extra[b] = name in strings, extra[b + 1, b + 1 + c) = args
+//   Assign    a = value, extra[b, b + c) = vars
+//   If        a = condition, b = body, c = else body
+class FlatNode {
+public:
+    std::uint8_t type;
+    std::uint8_t kind;
+    std::uint16_t flags;
+    std::uint32_t start;
+    std::uint32_t a, b, c;
+};
+
+// Contiguous copy of an Expr tree addressed by 32 bit indices. Children
+// are always stored before their parent, so a forward sweep over nodes
+// visits the tree bottom up.
+class FlatAst {
+private:
+    // operators of the left deep chains being added
+    std::vector<Binop*> spine;
+
+    std::uint32_t add(ExprPtr expr);
+    std::uint32_t add_node(ExprPtr expr, std::uint8_t kind,
+        std::uint32_t a, std::uint32_t b = FlatNull, std::uint32_t c = FlatNull);
+    std::uint32_t add_string(const StrView& str);
+
+    template <typename T>
+    std::uint32_t add_list(const ArenaVec<T>& list, std::uint32_t& count);
+
+public:
+    std::vector<FlatNode> nodes;
+    std::vector<std::uint32_t> extra;
+    std::vector<std::uint64_t> ints;
+    std::vector<double> floats;
+    std::vector<StrView> strings;
+    std::uint32_t root = FlatNull;
+
+    void clear();
+    FlatAst& build(ExprPtr tree);
+
+    void print(std::uint32_t node) const;
+    inline void print() const {
+        print(root);
+    }
+
+    // bytes used by every array
+    std::size_t bytes() const;
+};
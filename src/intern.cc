@@ -0,0 +1,92 @@
+#include "ast.hh"
+
+// multiplicative hash of a string taken 8 bytes at a time
+static inline std::uint32_t symbol_hash(const StrView& str) {
+    const std::uint64_t seed = 0x9e3779b97f4a7c15ull;
+    std::uint64_t hash = str.size * seed;
+    std::uint64_t word;
+    std::size_t i = 0;
+
+    for (; i + 8 <= str.size; i += 8) {
+        std::memcpy(&word, str.data + i, 8);
+        hash = (hash ^ word) * seed;
+        hash ^= hash >> 29;
+    }
+
+    if (i < str.size) {
+        word = 0;
+        std::memcpy(&word, str.data + i, str.size - i);
+        hash = (hash ^ word) * seed;
+    }
+
+    return std::uint32_t(hash ^ (hash >> 32));
+}
+
+std::uint32_t Interner::hash(const StrView& str) {
+    return symbol_hash(str);
+}
+
+Interner::Interner() : storage(16 * 1024) {
+    clear();
+}
+
+void Interner::clear() {
+    storage.release();
+    strings.clear();
+    table.assign(256, Slot { 0, SymbolNone });
+    intern(StrView("", 0));
+}
+
+// double the table, keeping it at most half full
+void Interner::grow() {
+    std::vector<Slot> old(table.size() * 2, Slot { 0, SymbolNone });
+    old.swap(table);
+
+    const std::size_t mask = table.size() - 1;
+    for (const Slot& entry : old) {
+        if (entry.symbol == SymbolNone) continue;
+        std::size_t slot = entry.hash & mask;
+        while (table[slot].symbol != SymbolNone)
+            slot = (slot + 1) & mask;
+        table[slot] = entry;
+    }
+}
+
+Symbol Interner::intern(const StrView& str) {
+    if ((strings.size() + 1) * 2 > table.size())
+        grow();
+
+    const std::uint32_t hash = symbol_hash(str);
+    const std::size_t mask = table.size() - 1;
+    std::size_t slot = hash & mask;
+
+    // linear probe until the string or an empty slot is found
+    for (; table[slot].symbol != SymbolNone; slot = (slot + 1) & mask) {
+        const Slot& entry = table[slot];
+        if (entry.hash == hash && strings[entry.symbol] == str)
+            return entry.symbol;
+    }
+
+    const Symbol symbol = Symbol(strings.size());
+    strings.push_back(storage.copy(str));
+    table[slot] = Slot { hash, symbol };
+    return symbol;
+}
+
+Symbol Interner::concat(const StrView& left, const StrView& right) {
+    const StrView parts[] = { left, right };
+    return concat(parts, 2);
+}
+
+// join strings into one buffer sized up front
+Symbol Interner::concat(const StrView* parts, std::size_t count) {
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < count; i++)
+        size += parts[i].size;
+
+    scratch.clear();
+    scratch.reserve(size);
+    for (std::size_t i = 0; i < count; i++)
+        scratch.append(parts[i].data, parts[i].size);
+    return intern(StrView(scratch.data(), scratch.size()));
+}
@@ -0,0 +1,312 @@
+#include "interpreter.hh"
+
+#include <algorithm>
+
+Interpreter::Interpreter(Parser& _parser) : parser(_parser), stack(InterpreterStack) {}
+
+Value Interpreter::run(ExprPtr tree, std::uint32_t frame_size) {
+    char marker;
+    native_base = reinterpret_cast<std::uintptr_t>(&marker);
+    top = frame_size;
+    returning = false;
+    if (top > stack.size())
+        parser.error(tree ? tree->token : Token(), "Stack overflow%s", "");
+
+    Frame frame(nullptr, stack.data());
+    std::fill(stack.begin(), stack.begin() + top, Value());
+    Value value = tree ? eval(tree, &frame) : Value();
+    if (returning) {
+        value = result;
+        returning = false;
+    }
+    return value;
+}
+
+// walk up to the frame of a lexical address
+Value* Interpreter::lookup(Frame* frame, std::uint32_t depth, std::uint32_t slot, const Token& token) {
+    while (depth--)
+        frame = frame->parent;
+    if (!frame)
+        parser.error(token, "Invalid variable address%s", "");
+    return &frame->slots[slot];
+}
+
+Value Interpreter::arith(const Token& token, OpKind op, const Value& left, const Value& right) {
+    Value value;
+    switch (value_arith(op, left, right, heap, value)) {
+        case ArithDivZero:
+            parser.error(token, "Division by zero%s", "");
+            break;
+        case ArithInvalid:
+            parser.error(token, "Invalid operator %s on %s and %s", Token::op_str(op),
+                Value::type_str(left.type()), Value::type_str(right.type()));
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+// operators that evaluate both sides and combine them with value_arith
+static inline bool is_arith_op(OpKind op) {
+    switch (op) {
+        case OpAnd: case OpOr: case OpAssign: case OpUpdate: case OpDot:
+            return false;
+        default:
+            return true;
+    }
+}
+
+Value Interpreter::eval_binop(Binop* expr, Frame* frame) {
+    switch (expr->op) {
+
+        // short circuiting logic
+        case OpAnd:
+            return Value::of_bool(eval(expr->left, frame).truthy()
+                && eval(expr->right, frame).truthy());
+        case OpOr:
+            return Value::of_bool(eval(expr->left, frame).truthy()
+                || eval(expr->right, frame).truthy());
+
+        // store into the slot of a resolved variable
+        case OpAssign:
+        case OpUpdate: {
+            ExprPtr target = expr->left;
+            if (!target || !target->is(EConst) || target->as<Const>()->const_type != EConstIdent)
+                parser.error(expr->token, "Invalid assignment target%s", "");
+            Var* var = target->as<Var>();
+            if (!var->decl)
+                parser.error(var->token, "Undefined variable %.*s", (int)var->name.size, var->name.data);
+            if (var->decl->is(EConst) && (var->decl->as<Var>()->flags & Var::Flag::Const))
+                parser.error(var->token, "Cannot assign to const %.*s", (int)var->name.size, var->name.data);
+            Value value = eval(expr->right, frame);
+            *lookup(frame, var->depth, var->slot, var->token) = value;
+            return value;
+        }
+
+        case OpDot:
+            parser.error(expr->token, "Member access is not supported%s", "");
+            return Value();
+
+        // left deep chains like a + b + c are evaluated along their
+        // spine, so their length does not use up the native stack
+        default: {
+            const std::size_t mark = spine.size();
+            ExprPtr link = expr;
+            for (; link && link->is(EBinop) && is_arith_op(link->as<Binop>()->op);
+                    link = link->as<Binop>()->left)
+                spine.push_back(link->as<Binop>());
+
+            Value left = eval(link, frame);
+            for (std::size_t i = spine.size(); i > mark; i--) {
+                Binop* e = spine[i - 1];
+                Value right = eval(e->right, frame);
+                left = arith(e->token, e->op, left, right);
+            }
+            spine.resize(mark);
+            return left;
+        }
+    }
+}
+
+// Direct cases are an || chain of `value == x` tests on the switch
+// value, which is only evaluated once and compared here instead.
+bool Interpreter::case_matches(ExprPtr test, ExprPtr value_expr, const Value& value, Frame* frame) {
+    if (test && test->is(EBinop)) {
+        Binop* op = test->as<Binop>();
+        if (op->op == OpOr)
+            return case_matches(op->left, value_expr, value, frame)
+                || case_matches(op->right, value_expr, value, frame);
+        if (op->op == OpEq && op->left == value_expr)
+            return value.equals(eval(op->right, frame));
+    }
+    return test && eval(test, frame).truthy();
+}
+
+Value Interpreter::eval_switch(Switch* expr, Frame* frame) {
+    const Value value = eval(expr->value, frame);
+
+    for (Case* c : expr->cases) {
+        CaseCondition* cond = c->condition;
+        bool matched;
+
+        // `case n when ...` binds the value before testing
+        if (!cond->is_direct) {
+            ExprPtr pattern = cond->value;
+            if (pattern && pattern->is(EConst) && pattern->as<Const>()->const_type == EConstIdent)
+                frame->slots[pattern->as<Var>()->slot] = value;
+            else if (pattern && !value.equals(eval(pattern, frame)))
+                continue;
+            matched = cond->condition && eval(cond->condition, frame).truthy();
+        } else {
+            matched = case_matches(cond->condition, expr->value, value, frame);
+        }
+
+        if (matched)
+            return c->body ? eval(c->body, frame) : Value();
+    }
+
+    return Value();
+}
+
+Value Interpreter::builtin(Call* expr, Frame* frame) {
+    if (expr->name == StrView("print")) {
+        // evaluate every argument first so nested prints come out
+        // before this line, the same as the vm's BcPrint
+        std::vector<Value> args;
+        args.reserve(expr->args.size());
+        for (ExprPtr arg : expr->args)
+            args.push_back(eval(arg, frame));
+        for (std::size_t i = 0; i < args.size(); i++) {
+            if (i > 0) std::printf(" ");
+            args[i].print();
+        }
+        std::printf("\n");
+        return Value();
+    }
+
+    parser.error(expr->token, "Undefined function %.*s", (int)expr->name.size, expr->name.data);
+    return Value();
+}
+
+Value Interpreter::call(Call* expr, Frame* frame) {
+    if (!expr->decl)
+        return builtin(expr, frame);
+
+    const Value callee = *lookup(frame, expr->depth, expr->slot, expr->token);
+    if (!callee.is(VFunction))
+        parser.error(expr->token, "%.*s is not a function", (int)expr->name.size, expr->name.data);
+
+    // the stack grows down, stop before running out of it
+    char marker;
+    if (native_base - reinterpret_cast<std::uintptr_t>(&marker) > InterpreterNativeStack)
+        parser.error(expr->token, "Stack overflow calling %.*s", (int)expr->name.size, expr->name.data);
+
+    const Closure* closure = callee.as_closure();
+    Function* func = closure->function;
+    const std::size_t base = top;
+
+    // frames a closure may hold on to live on the heap
+    Value* slots;
+    if (func->frame_captured) {
+        slots = static_cast<Value*>(heap.alloc(func->frame_size * sizeof(Value), alignof(Value)));
+    } else {
+        if (top + func->frame_size > stack.size())
+            parser.error(expr->token, "Stack overflow calling %.*s", (int)expr->name.size, expr->name.data);
+        slots = stack.data() + top;
+        top += func->frame_size;
+    }
+    std::fill(slots, slots + func->frame_size, Value());
+
+    Frame local(closure->env, slots);
+    Frame* callee_frame = func->frame_captured ? heap.make<Frame>(local) : &local;
+
+    // arguments are evaluated in the caller, extra ones are dropped
+    for (std::size_t i = 0; i < expr->args.size(); i++) {
+        Value arg = eval(expr->args[i], frame);
+        if (i < func->args.size())
+            slots[func->args[i]->slot] = arg;
+    }
+
+    Value value = func->body ? eval(func->body, callee_frame) : Value();
+    top = base;
+
+    if (returning) {
+        value = result;
+        returning = false;
+    }
+    return value;
+}
+
+Value Interpreter::eval(ExprPtr expr, Frame* frame) {
+    switch (expr->type) {
+
+        case EConst: {
+            Const* e = expr->as<Const>();
+            switch (e->const_type) {
+                case EConstInt:
+                    return Value::of_int(std::int64_t(e->as<ConstInt>()->value), heap);
+                case EConstFloat:
+                    return Value::of_float(e->as<ConstFloat>()->value);
+                case EConstString:
+                    return Value::of_string(&e->as<ConstString>()->value);
+                case EConstIdent: {
+                    Var* var = e->as<Var>();
+                    if (!var->decl)
+                        parser.error(var->token, "Undefined variable %.*s",
+                            (int)var->name.size, var->name.data);
+                    return *lookup(frame, var->depth, var->slot, var->token);
+                }
+                default:
+                    return Value();
+            }
+        }
+
+        case EUnop: {
+            Unop* e = expr->as<Unop>();
+            Value value = eval(e->value, frame);
+            if (e->op != OpSub)
+                return value;
+            if (value.is(VInt))
+                return Value::of_int(std::int64_t(0 - std::uint64_t(value.as_int())), heap);
+            if (value.is(VFloat))
+                return Value::of_float(-value.as_float());
+            parser.error(e->token, "Invalid unary operator - on %s", Value::type_str(value.type()));
+            return Value();
+        }
+
+        case EBinop:
+            return eval_binop(expr->as<Binop>(), frame);
+
+        case EReturn: {
+            ExprPtr value = expr->as<Return>()->value;
+            result = value ? eval(value, frame) : Value();
+            returning = true;
+            return result;
+        }
+
+        case ECall:
+            return call(expr->as<Call>(), frame);
+
+        case EBlock: {
+            Value value;
+            for (ExprPtr e : expr->as<Block>()->body) {
+                if (!e) continue;
+                value = eval(e, frame);
+                if (returning) break;
+            }
+            return value;
+        }
+
+        case EIf: {
+            If* e = expr->as<If>();
+            if (e->condition && eval(e->condition, frame).truthy())
+                return e->body ? eval(e->body, frame) : Value();
+            return e->else_body ? eval(e->else_body, frame) : Value();
+        }
+
+        case ESwitch:
+            return eval_switch(expr->as<Switch>(), frame);
+
+        // creating a function captures the current frame
+        case EFunction: {
+            Function* e = expr->as<Function>();
+            Value value = Value::of_closure(heap.make<Closure>(e, frame));
+            if (e->name.size > 0)
+                frame->slots[e->slot] = value;
+            return value;
+        }
+
+        case EAssign: {
+            Assign* e = expr->as<Assign>();
+            Value value = e->value ? eval(e->value, frame) : Value();
+            for (Var* var : e->vars)
+                frame->slots[var->slot] = value;
+            return value;
+        }
+
+        default:
+            parser.error(expr->token, "Cannot evaluate %s", Expr::type_str(expr->type));
+            return Value();
+    }
+}
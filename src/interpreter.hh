@@ -0,0 +1,46 @@
+#pragma once
+
+#include "value.hh"
+
+// values on the interpreter stack, frames of calls no closure can
+// outlive take their slots from it
+#define InterpreterStack (1 << 20)
+
+// bytes of native stack nested calls may use before a program is
+// stopped, kept below the usual 8MB thread stack
+#define InterpreterNativeStack (6 << 20)
+
+// Tree walking evaluator over the analyzed ast. Variables are read
+// through the (depth, slot) addresses assigned by the resolver. Only
+// calls check the native stack, other nesting recurses unchecked
+// except for left deep operator chains, which are walked in a loop.
+class Interpreter {
+private:
+    Parser& parser;
+    // operators of the left deep chains being evaluated
+    std::vector<Binop*> spine;
+    Arena heap;
+    std::vector<Value> stack;
+    std::size_t top = 0;
+    std::uintptr_t native_base = 0;
+
+    // set by a return until the enclosing call picks up its value
+    bool returning = false;
+    Value result;
+
+    Value eval(ExprPtr expr, Frame* frame);
+    Value eval_binop(Binop* expr, Frame* frame);
+    Value eval_switch(Switch* expr, Frame* frame);
+    Value call(Call* expr, Frame* frame);
+    Value builtin(Call* expr, Frame* frame);
+    bool case_matches(ExprPtr test, ExprPtr value_expr, const Value& value, Frame* frame);
+
+    Value* lookup(Frame* frame, std::uint32_t depth, std::uint32_t slot, const Token& token);
+    Value arith(const Token& token, OpKind op, const Value& left, const Value& right);
+
+public:
+    Interpreter(Parser& _parser);
+
+    // evaluate a tree whose top level needs frame_size slots
+    Value run(ExprPtr tree, std::uint32_t frame_size);
+};
@@ -1,33 +1,69 @@
 #include "ast.hh"
+#include "scan.hh"
 
-#include <array>
 #include <cstring>
 #include <utility>
 
-Lexer& Lexer::feed(const std::string& filename, const std::string& code) {
-    lineno = 1;
+Lexer& Lexer::feed(const Source& source) {
     current = 0;
-    file = filename;
-    this->code = code;
+    file = source.file;
+    code = source.view();
+    lines = &source.lines;
     return *this;
 }
 
+void TokenBuffer::fill(Lexer& lexer) {
+    if (lexer.code.size > UINT32_MAX)
+        throw ParserError(sformat("%s is too large to prelex", lexer.file.c_str()));
+
+    code = lexer.code;
+    types.clear();
+    ids.clear();
+    starts.clear();
+    lengths.clear();
+
+    // roughly one token every few bytes of source
+    const std::size_t estimate = code.size / 5 + 1;
+    types.reserve(estimate);
+    ids.reserve(estimate);
+    starts.reserve(estimate);
+    lengths.reserve(estimate);
+
+    Token token;
+    do {
+        token = lexer.next();
+        types.push_back(token.type);
+        ids.push_back(token.id);
+        starts.push_back(token.start);
+        lengths.push_back(token.text.size);
+    } while (!token.is(Eof));
+}
+
 ///////////////////////////////////////////////////////////////
 
 // valid operator characters
-static const char* OperatorChars = "+-*/%.:=<>|&^";
+static constexpr const char* OperatorChars = "+-*/%.:=<>|&^!";
+
+// expand fn(i) over a range of table slots
+#define slots_4(fn, i) fn(i), fn(i + 1), fn(i + 2), fn(i + 3)
+#define slots_16(fn, i) \
+    slots_4(fn, i), slots_4(fn, i + 4), slots_4(fn, i + 8), slots_4(fn, i + 12)
+#define slots_64(fn, i) \
+    slots_16(fn, i), slots_16(fn, i + 16), slots_16(fn, i + 32), slots_16(fn, i + 48)
+#define slots_256(fn, i) \
+    slots_64(fn, i), slots_64(fn, i + 64), slots_64(fn, i + 128), slots_64(fn, i + 192)
 
-// language keywords
-static const std::vector<std::string> Keywords = {
+// language keywords, indexed by KeywordKind
+static constexpr const char* Keywords[KwCount] = { "",
     KeywordSwitch, KeywordCase, KeywordWhen,
     KeywordIf, KeywordElse, KeywordThen,
     KeywordDeclare, KeywordConst, KeywordRef,
     KeywordImport, KeywordReturn, KeywordFunction
 };
 
-// language operators
-static const std::vector<std::string> Operators = {
-    // match operators
+// language operators, indexed by OpKind
+static constexpr const char* Operators[OpCount] = { "",
+    // math operators
     "+", "-", "*", "/", "%",
     // binary operators
     "<<", ">>", "&", "^", "|",
@@ -37,130 +73,230 @@ static const std::vector<std::string> Operators = {
     ">", "<", ">=", "<=", "==", "!=", "&&", "||"
 };
 
-// check if char is an operator
-static inline bool is_operator(const char c) {
-    return std::strchr(OperatorChars, c) != nullptr;
+const char* Token::keyword_str(KeywordKind keyword) {
+    return Keywords[keyword];
 }
 
-// check if char is not a string delimiter
-static inline bool is_not_str(const char c) {
-    return c != '"';
+const char* Token::op_str(OpKind op) {
+    return Operators[op];
 }
 
-// check if char is a digit
-static inline bool is_digit(const char c) {
-    return (c >= '0' && c <= '9');
+///////////////////////////////////////////////////////////////
+
+// Keywords and operators are recognized with compile time generated
+// perfect hashes: each table slot holds the only id that can hash to it,
+// so a lookup is one multiply, one load and a single compare. The
+// static_asserts below fire if a changed keyword introduces a collision,
+// in which case a new seed has to be picked.
+
+#define KeywordSeed 0x4251eu
+#define KeywordBits 4
+#define OperatorSeed 0x843a6347u
+#define OperatorBits 5
+
+static constexpr std::size_t cstrlen(const char* str) {
+    return *str ? 1 + cstrlen(str + 1) : 0;
 }
 
-// check if char is numeric (decimal point or digit)
-static inline bool is_numeric(const char c) {
-    return is_digit(c) || c == '.';
+// keyword hash from the length, first and last char
+static constexpr std::uint32_t keyword_hash(const char* str, std::size_t size) {
+    return ((std::uint32_t(size)
+        | std::uint32_t(std::uint8_t(str[0])) << 8
+        | std::uint32_t(std::uint8_t(str[size - 1])) << 16)
+        * KeywordSeed) >> (32 - KeywordBits);
 }
 
-// check if char is valid identifier start
-static inline bool is_ident_start(const char c) {
-    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
-        || c == '_' || c == '$';
+// operator hash from its (at most 3) chars
+static constexpr std::uint32_t op_hash(const char* str, std::size_t size) {
+    return ((std::uint32_t(std::uint8_t(str[0]))
+        | (size > 1 ? std::uint32_t(std::uint8_t(str[1])) << 8 : 0)
+        | (size > 2 ? std::uint32_t(std::uint8_t(str[2])) << 16 : 0))
+        * OperatorSeed) >> (32 - OperatorBits);
 }
 
-// check if char is an identifier
-static inline bool is_ident(const char c) {
-    return is_ident_start(c) || is_digit(c);
+static constexpr std::uint32_t keyword_hash_of(int kw) {
+    return keyword_hash(Keywords[kw], cstrlen(Keywords[kw]));
 }
 
-// check if char is a whitespace
-static inline bool is_whitespace(const char c) {
-    switch (c) {
-        case ' ': case '\t': case '\r': return true;
-        default: return false;
-    }
+static constexpr std::uint32_t op_hash_of(int op) {
+    return op_hash(Operators[op], cstrlen(Operators[op]));
 }
 
-// check if char is valid grammar
-static inline bool is_grammar(const char c) {
-    switch (c) {
-        case '(':
-        case ')':
-        case '{':
-        case '}':
-        case '[':
-        case ']':
-        case ',':
-        case ';':
-            return true;
-        default:
-            return false;
-    }
+// id owning a hash table slot
+static constexpr std::uint8_t keyword_slot(std::uint32_t slot, int kw = 1) {
+    return kw >= KwCount ? 0 :
+        keyword_hash_of(kw) == slot ? kw : keyword_slot(slot, kw + 1);
+}
+
+static constexpr std::uint8_t op_slot(std::uint32_t slot, int op = 1) {
+    return op >= OpCount ? 0 :
+        op_hash_of(op) == slot ? op : op_slot(slot, op + 1);
+}
+
+// check that no two ids share a slot
+static constexpr bool keywords_unique(int a = 1, int b = 2) {
+    return a >= KwCount ? true :
+        b >= KwCount ? keywords_unique(a + 1, a + 2) :
+        keyword_hash_of(a) != keyword_hash_of(b) && keywords_unique(a, b + 1);
+}
+
+static constexpr bool ops_unique(int a = 1, int b = 2) {
+    return a >= OpCount ? true :
+        b >= OpCount ? ops_unique(a + 1, a + 2) :
+        op_hash_of(a) != op_hash_of(b) && ops_unique(a, b + 1);
+}
+
+static_assert(keywords_unique(), "keyword hash collision, pick a new KeywordSeed");
+static_assert(ops_unique(), "operator hash collision, pick a new OperatorSeed");
+
+static constexpr std::uint8_t KeywordTable[1 << KeywordBits] = {
+    slots_16(keyword_slot, 0)
+};
+
+static constexpr std::uint8_t OperatorTable[1 << OperatorBits] = {
+    slots_16(op_slot, 0), slots_16(op_slot, 16)
+};
+
+// compare a view against a nul terminated table entry
+static inline bool matches(const StrView& text, const char* str) {
+    return std::strncmp(text.data, str, text.size) == 0 && str[text.size] == '\0';
+}
+
+// find keyword id of an identifier
+static inline KeywordKind keyword_find(const StrView& text) {
+    const std::uint8_t kw = KeywordTable[keyword_hash(text.data, text.size)];
+    return kw && matches(text, Keywords[kw]) ? KeywordKind(kw) : KwNone;
+}
+
+// find operator id of an operator run
+static inline OpKind op_find(const StrView& text) {
+    if (text.size > 3) return OpNone;
+    const std::uint8_t op = OperatorTable[op_hash(text.data, text.size)];
+    return op && matches(text, Operators[op]) ? OpKind(op) : OpNone;
+}
+
+///////////////////////////////////////////////////////////////
+
+// Every byte maps to one entry of CharTable: the low bits are the class
+// of token the char starts (switched on by Lexer::next), the high bits
+// tell which token runs the char can continue (tested by read_until).
+
+typedef enum {
+    CharInvalid  = 0,
+    CharSpace    = 1,
+    CharNewline  = 2,
+    CharQuote    = 3,
+    CharDigit    = 4,
+    CharOperator = 5,
+    CharIdent    = 6,
+    CharGrammar  = 7
+} CharClass;
+
+#define CharClassMask  0x07
+#define CharIsString   0x08
+#define CharIsIdent    0x10
+#define CharIsNumeric  0x20
+#define CharIsOperator 0x40
+#define CharIsSpace    0x80
+
+// check if char is part of a nul terminated set
+static constexpr bool char_in(const char* set, unsigned c) {
+    return *set && (std::uint8_t(*set) == c || char_in(set + 1, c));
 }
 
-// check if string is from a list of strings
-static inline bool is_from(const std::vector<std::string>& group, const std::string& text) {
-    for (const std::string& str : group)
-        if (text == str)
-            return true;
-    return false;
+// compute the class of a char and the runs it continues
+static constexpr std::uint8_t char_entry(unsigned c) {
+    return (c == '"' ? 0 : CharIsString) | (
+        (c == ' ' || c == '\t' || c == '\r') ? CharSpace | CharIsSpace :
+        c == '\n' ? CharNewline :
+        c == '"' ? CharQuote :
+        (c >= '0' && c <= '9') ? CharDigit | CharIsIdent | CharIsNumeric :
+        c == '.' ? CharOperator | CharIsOperator | CharIsNumeric :
+        char_in(OperatorChars, c) ? CharOperator | CharIsOperator :
+        ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$') ?
+            CharIdent | CharIsIdent :
+        char_in("(){}[],;", c) ? CharGrammar :
+        CharInvalid);
 }
 
+static constexpr std::uint8_t CharTable[256] = {
+    slots_256(char_entry, 0)
+};
+
+// get table entry / class of a char
+#define char_info(c) (CharTable[std::uint8_t(c)])
+#define char_class(c) (char_info(c) & CharClassMask)
+
 // check if lexer still has content
 #define is_valid(lexer) \
-    ((lexer).current < (lexer).code.size())
+    ((lexer).current < (lexer).code.size)
 
 // get current char of lexer
 #define lex_char(lexer) \
-    ((lexer).code[(lexer).current])
-
-// read until condition
-#define read_until(lexer, check) \
-    register std::size_t size = 0;                       \
-    std::size_t start = (lexer).current;                 \
-    const std::size_t lineno = lexer.lineno;             \
-    while (is_valid(lexer) && check(lex_char(lexer))) {  \
-        size++;                                          \
-        (lexer).current++;                               \
-    }
+    ((lexer).code.data[(lexer).current])
+
+// advance while chars continue the run given by mask, long runs
+// are handed to the vector kernel once they pass ScanThreshold
+#define skip_run(lexer, mask, kernel) {                                 \
+    const std::size_t run_start = (lexer).current;                      \
+    while (is_valid(lexer) && (char_info(lex_char(lexer)) & mask))      \
+        if (++(lexer).current - run_start == ScanThreshold)             \
+            (lexer).current = kernel(                                   \
+                (lexer).code.data, (lexer).current, (lexer).code.size); \
+}
 
-// get token text string
+// read a token run into start / size
+#define read_until(lexer, mask, kernel)              \
+    const std::size_t start = (lexer).current;       \
+    skip_run(lexer, mask, kernel)                    \
+    const std::size_t size = (lexer).current - start;
+
+// get token text view into the source
 #define token_str(lexer) \
-    std::string((lexer).code.c_str() + start, size)
+    StrView((lexer).code.data + start, size)
+
+// symbol of a token text, 0 when the lexer has no symbol table
+#define token_symbol(lexer, text) \
+    ((lexer).symbols ? (lexer).symbols->intern(text) : 0)
 
 // parse a string
 static inline Token parse_string(Lexer& lexer) {
     lexer.current++;
-    read_until(lexer, is_not_str)
+    read_until(lexer, CharIsString, Scan.string)
     lexer.current++;
-    return Token(String, token_str(lexer), start, lineno);
+    StrView text = token_str(lexer);
+    return Token(String, text, start, token_symbol(lexer, text));
 }
 
 // parse an identifier
 static inline Token parse_ident(Lexer& lexer) {
-    TokenType type = Ident;
-    read_until(lexer, is_ident)
-    std::string text = token_str(lexer);
-    if (is_from(Keywords, text))
-        type = Keyword;
-    return Token(type, text, start, lineno);
+    read_until(lexer, CharIsIdent, Scan.ident)
+    StrView text = token_str(lexer);
+    KeywordKind keyword = keyword_find(text);
+    if (keyword)
+        return Token(Keyword, text, start, keyword);
+    return Token(Ident, text, start, token_symbol(lexer, text));
 }
 
 // parse a number
 static inline Token parse_number(Lexer& lexer) {
-    read_until(lexer, is_numeric)
-    std::string text = token_str(lexer);
+    read_until(lexer, CharIsNumeric, Scan.numeric)
+    StrView text = token_str(lexer);
     if (strcount(text, '.') > 1)
-        throw ParserError::from(lexer, start, lexer.file, lineno,
-            "Invalid float literal %s", text.c_str());
-    return Token(Number, text, start, lineno);
+        throw ParserError::from(lexer, start,
+            "Invalid float literal %.*s", (int)text.size, text.data);
+    return Token(Number, text, start);
 }
 
 // parse an operator
 static inline Token parse_operator(Lexer& lexer) {
-    TokenType type = Operator;
-    read_until(lexer, is_operator)
-    std::string text = token_str(lexer);
-    if (text == "->") type = Arrow;
-    if (!is_from(Operators, text))
-        throw ParserError::from(lexer, start, lexer.file, lineno,
-            "Invalid operator %s", text.c_str());
-    return Token(type, text, start, lineno);
+    read_until(lexer, CharIsOperator, scan_scalar)
+    StrView text = token_str(lexer);
+    OpKind op = op_find(text);
+    if (!op)
+        throw ParserError::from(lexer, start,
+            "Invalid operator %.*s", (int)text.size, text.data);
+    return Token(op == OpArrow ? Arrow : Operator, text, start, op);
 }
 
 // parse a grammar character
@@ -168,7 +304,7 @@ static inline Token parse_grammar(Lexer& lexer) {
     TokenType type = None;
     const std::size_t size = 1;
     const std::size_t start = lexer.current;
-    switch (lexer.code[lexer.current++]) {
+    switch (lexer.code.data[lexer.current++]) {
         case '(': type = LParen; break;
         case ')': type = RParen; break;
         case '{': type = LCurly; break;
@@ -179,43 +315,36 @@ static inline Token parse_grammar(Lexer& lexer) {
         case ';': type = Semicolon; break;
         default: break;
     }
-    return Token(type, token_str(lexer), start, lexer.lineno);
+    return Token(type, token_str(lexer), start);
 }
 
 static inline Token parse_newline(Lexer& lexer) {
     const std::size_t size = 1;
     const std::size_t start = lexer.current++;
-    return Token(Newline, token_str(lexer), start, lexer.lineno++);
+    return Token(Newline, token_str(lexer), start);
 }
 
 // parse next token
 Token Lexer::next() {
-    // skip whitespace / lines
-    while (is_valid(*this) && is_whitespace(lex_char(*this)))
-        if (code.at(current++) == '\n')
-            lineno++;
+    // skip whitespace
+    skip_run(*this, CharIsSpace, Scan.space)
     
     // no more tokens
     if (!is_valid(*this))
-        return Token(Eof);
+        return Token(Eof, current);
 
     // parse the current token
-    if (lex_char(*this) == '\n')
-        return parse_newline(*this);
-    if (lex_char(*this) == '"')
-        return std::move(parse_string(*this));
-    if (is_digit(lex_char(*this)))
-        return std::move(parse_number(*this));
-    if (is_operator(lex_char(*this)))
-        return std::move(parse_operator(*this));
-    if (is_ident_start(lex_char(*this)))
-        return std::move(parse_ident(*this));
-    if (is_grammar(lex_char(*this)))
-        return std::move(parse_grammar(*this));
+    switch (char_class(lex_char(*this))) {
+        case CharNewline: return parse_newline(*this);
+        case CharQuote: return parse_string(*this);
+        case CharDigit: return parse_number(*this);
+        case CharOperator: return parse_operator(*this);
+        case CharIdent: return parse_ident(*this);
+        case CharGrammar: return parse_grammar(*this);
+        default: break;
+    }
 
     // invalid character found
-    throw ParserError::from(*this, current, file, lineno,
-        "Invalid char: %c", code[current]);
-
-    return Token();
-}
\ No newline at end of file
+    throw ParserError::from(*this, current,
+        "Invalid char: %c", code.data[current]);
+}
@@ -1,10 +1,65 @@
-#include "compiler.hh"
-
-int main() {
-    const char* code = R"(
-        "hello " + "world"
-    )";
-
-    Compiler compiler;
-    return compiler.compile(code);
-}
\ No newline at end of file
+#include "compiler.hh"
+
+static int usage(const char* program) {
+    std::fprintf(stderr,
+        "usage: %s [run] [options] [file...]\n"
+        "  run         execute the files instead of printing their ast\n"
+        "  --prelex    lex each file completely before parsing it\n"
+        "  --flat      optimize and print the flat ast instead of the tree\n"
+        "  --vm        run with the bytecode vm instead of walking the tree\n"
+        "  --bytecode  print the compiled bytecode instead of the ast\n"
+        "  --passes=a,b  run only the listed optimizer passes, in order\n"
+        "  --pass-stats  print what each optimizer pass did to stderr\n"
+        "reads stdin when no file (or '-') is given\n", program);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    Compiler compiler;
+    std::vector<std::string> files;
+
+    int first = 1;
+    if (argc > 1 && std::string(argv[1]) == "run") {
+        compiler.options.run = true;
+        first = 2;
+    }
+
+    for (int i = first; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--prelex")
+            compiler.options.prelex = true;
+        else if (arg == "--flat")
+            compiler.options.flat = true;
+        else if (arg == "--vm")
+            compiler.options.vm = true;
+        else if (arg == "--bytecode")
+            compiler.options.bytecode = true;
+        else if (arg.compare(0, 9, "--passes=") == 0)
+            compiler.options.passes = arg.substr(9);
+        else if (arg == "--pass-stats")
+            compiler.options.pass_stats = true;
+        else if (arg.size() > 1 && arg[0] == '-')
+            return usage(argv[0]);
+        else
+            files.push_back(arg);
+    }
+
+    if (files.empty())
+        files.push_back("-");
+
+    int status = 0;
+    for (const std::string& file : files) {
+        Source source;
+        try {
+            source.open(file);
+        } catch (const std::exception& err) {
+            std::fprintf(stderr, "%s\n", err.what());
+            status = 1;
+            continue;
+        }
+        if (compiler.compile(source))
+            status = 1;
+    }
+
+    return status;
+}
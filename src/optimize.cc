@@ -1,179 +1,1429 @@
 #include "compiler.hh"
 
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
 #define expr_is_const(e) ((e) && ((e)->type == EConst))
 #define is_ctype(e, type) ((e)->const_type == type)
 #define e_to_val(e, type) ((e)->as<type>()->value)
+#define is_var(e) \
+    ((e) && (e)->is(EConst) && (e)->as<Const>()->const_type == EConstIdent)
 
-#define const_cross_operators \
-    if (op == "+") return left + right; \
-    if (op == "-") return left - right; \
-    if (op == "*") return left * right; \
-    if (op == "/") return left / right
-
-#define const_int_operators \
-    if (op == "&") return left & right; \
-    if (op == "^") return left ^ right; \
-    if (op == "|") return left | right; \
-    if (op == "%") return left % right; \
-    if (op == ">>") return left >> right; \
-    if (op == "<<") return left << right
-    
-#define binop_combinator(name, body)     \
-    template <typename L, typename R>    \
-    static inline L name(                \
-        Parser& p, const Token& token,   \
-        const L& left, const R& right) { \
-        const std::string& op = token.text; \
-        body;                               \
-        p.error(token,                      \
-            "Invalid operator %s on constant expressions", op.c_str()); \
-        return left; \
-    }
-
-binop_combinator(const_combine, const_cross_operators)
-binop_combinator(const_combine_int, const_cross_operators; const_int_operators)
-
-static inline Const* binop_resolve(Parser &p, const Token& token, Const* left, Const* right) {
-    if (is_ctype(left, EConstIdent) || is_ctype(right, EConstIdent))
+// runtime value of a literal, false for names and this
+static inline bool const_value(Parser& p, Const* value, Value& out) {
+    switch (value->const_type) {
+        case EConstInt:
+            out = Value::of_int(std::int64_t(e_to_val(value, ConstInt)), p.arena);
+            return true;
+        case EConstFloat:
+            out = Value::of_float(e_to_val(value, ConstFloat));
+            return true;
+        case EConstString:
+            out = Value::of_string(&value->as<ConstString>()->value);
+            return true;
+        case EConstNull:
+            out = Value();
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Fold an operator on two numbers exactly as the runtime computes it,
+// so ints stay signed and wrap, shifts are masked and INT64_MIN / -1
+// does not trap. Operands the runtime would reject are errors here.
+static inline Value const_arith(Parser& p, const Token& token, OpKind op, const Value& left, const Value& right) {
+    Value out;
+    switch (value_arith(op, left, right, p.arena, out)) {
+        case ArithOk:
+            break;
+        case ArithDivZero:
+            p.error(token, "Division by zero in constant expression%s", "");
+            break;
+        default:
+            p.error(token, "Invalid operator %s on constant expressions", Token::op_str(op));
+            break;
+    }
+    return out;
+}
+
+// fold unary minus, the only unary operator with a constant result
+static inline Value const_negate(Parser& p, const Token& token, OpKind op, const Value& value) {
+    if (op != OpSub)
+        p.error(token, "Invalid operator %s on constant expressions", Token::op_str(op));
+    if (value.is(VInt))
+        return Value::of_int(std::int64_t(0 - std::uint64_t(value.as_int())), p.arena);
+    return Value::of_float(-value.as_float());
+}
+
+// literal holding a folded number
+static inline Const* const_number(Parser& p, const Token& token, const Value& value) {
+    if (value.is(VInt))
+        return p.make<ConstInt>(token, std::uint64_t(value.as_int()));
+    return p.make<ConstFloat>(token, value.as_float());
+}
+
+// check if an expression is a literal value, not a name or this
+static inline bool is_literal(ExprPtr expr) {
+    if (!expr_is_const(expr))
+        return false;
+    const ConstExprType type = expr->as<Const>()->const_type;
+    return type != EConstIdent && type != EConstThis;
+}
+
+// truth of an expression if it is a literal, -1 when only known at run time
+static inline int const_truth(Parser& p, ExprPtr expr) {
+    Value value;
+    if (!expr_is_const(expr) || !const_value(p, expr->as<Const>(), value))
+        return -1;
+    return value.truthy();
+}
+
+// Fold comparisons and logic to the int 0 or 1 the runtime would give,
+// operands it would reject are left for the runtime to report.
+static inline Const* compare_resolve(Parser& p, Binop* op, Const* left, Const* right) {
+    Value l, r, out;
+    if (!const_value(p, left, l) || !const_value(p, right, r))
         return nullptr;
-    Const* resolved = nullptr;
 
-    // int op int
-    if (is_ctype(left, EConstInt) && is_ctype(right, EConstInt))
-        resolved = new ConstInt(left->token, const_combine_int(p, token,
-            e_to_val(left, ConstInt), e_to_val(right, ConstInt)));
+    bool result;
+    if (op->op == OpAnd)
+        result = l.truthy() && r.truthy();
+    else if (op->op == OpOr)
+        result = l.truthy() || r.truthy();
+    else if (value_arith(op->op, l, r, p.arena, out) == ArithOk)
+        result = out.truthy();
+    else
+        return nullptr;
+    return p.make<ConstInt>(left->token, std::uint64_t(result));
+}
 
-    // int op float
-    if (is_ctype(left, EConstInt) && is_ctype(right, EConstFloat))
-        resolved = new ConstInt(left->token, const_combine(p, token,
-            e_to_val(left, ConstInt), e_to_val(right, ConstFloat)));
+static inline Const* binop_resolve(Parser &p, Binop* op, Const* left, Const* right) {
+    if (is_compare(op->op) || op->op == OpAnd || op->op == OpOr)
+        return compare_resolve(p, op, left, right);
 
-    // float op int
-    if (is_ctype(left, EConstFloat) && is_ctype(right, EConstInt))
-        resolved = new ConstInt(left->token, const_combine(p, token,
-            e_to_val(left, ConstInt), e_to_val(right, ConstInt)));
+    const bool left_num = is_ctype(left, EConstInt) || is_ctype(left, EConstFloat);
+    const bool right_num = is_ctype(right, EConstInt) || is_ctype(right, EConstFloat);
 
-    // float op float
-    if (is_ctype(left, EConstFloat) && is_ctype(right, EConstFloat))
-        resolved = new ConstInt(left->token, const_combine(p, token,
-            e_to_val(left, ConstFloat), e_to_val(right, ConstFloat)));
+    // int op int, float op int, int op float, float op float
+    if (left_num && right_num) {
+        Value l, r;
+        const_value(p, left, l);
+        const_value(p, right, r);
+        return const_number(p, left->token, const_arith(p, op->token, op->op, l, r));
+    }
 
     // string op string
-    if (is_ctype(left, EConstString) && is_ctype(right, EConstString) && token.text == "+")
-        resolved = new ConstString(left->token,
-            e_to_val(left, ConstString) + e_to_val(right, ConstString));
+    if (is_ctype(left, EConstString) && is_ctype(right, EConstString) && op->op == OpAdd) {
+        const Symbol symbol = p.symbols.concat(
+            e_to_val(left, ConstString), e_to_val(right, ConstString));
+        return p.make<ConstString>(left->token, p.symbols.str(symbol), symbol);
+    }
     
-    return resolved;
+    return nullptr;
 }
 
-static inline Const* unary_resolve(Parser& p, const Token& token, Const* value) {
+static inline Const* unary_resolve(Parser& p, Unop* op, Const* value) {
     switch (value->const_type) {
         case EConstInt:
-            return new ConstInt(token, const_combine(
-                p, token, 0, e_to_val(value, ConstInt)));
-        case EConstFloat:
-            return new ConstFloat(token, const_combine(
-                p, token, 0.0, e_to_val(value, ConstFloat)));
+        case EConstFloat: {
+            Value number;
+            const_value(p, value, number);
+            return const_number(p, op->token, const_negate(p, op->token, op->op, number));
+        }
+        case EConstIdent:
+            return nullptr;
         default:
-            p.error(token, "Invalid unary operator %s on constant expression",
-                token.text.c_str());
+            p.error(op->token, "Invalid unary operator %s on constant expression",
+                Token::op_str(op->op));
             return nullptr;
     }
 }
 
-#define const_fold_list(list, type) \
-    for (std::size_t i = 0; i < list.size(); i++) \
-        list[i] = static_cast<type>(constant_fold(p, list[i]))
+// operand of a + chain and the node that added it
+struct ConcatPart {
+    ExprPtr expr;
+    Binop* joint;
+};
 
-static inline ExprPtr constant_fold(Parser& p, ExprPtr expr) {
-    if (!expr) return expr;
-    switch (expr->type) {
+// Fold a left deep chain of + in one pass. Runs of adjacent string
+// constants anywhere in the chain are joined into a single buffer, so
+// "a" + x + "b" + "c" becomes "a" + x + "bc" without building the
+// intermediate strings. Numbers still only fold from the front, since
+// x + 1 + 2 may not be x + 3 once floats or strings are involved.
+static ExprPtr fold_concat(Optimizer& o, Binop* top) {
+    Parser& p = o.parser;
+
+    // a link of a longer chain is folded with the rest of it from the top
+    if (o.chain_link)
+        return top;
+
+    // a lone + needs no chain
+    if (!top->left || !top->left->is(EBinop) || top->left->as<Binop>()->op != OpAdd) {
+        if (!expr_is_const(top->left) || !expr_is_const(top->right))
+            return top;
+        Const* combined = binop_resolve(p, top, top->left->as<Const>(), top->right->as<Const>());
+        if (combined)
+            return combined;
+        return top;
+    }
+
+    std::vector<Binop*> spine;
+    ExprPtr base = top;
+    while (base && base->is(EBinop) && base->as<Binop>()->op == OpAdd) {
+        spine.push_back(base->as<Binop>());
+        base = base->as<Binop>()->left;
+    }
+
+    std::vector<ConcatPart> parts;
+    std::vector<StrView> run;
+    std::size_t run_start = 0;
 
+    #define concat_flush()                                                      \
+        if (run.size() > 1) {                                                   \
+            const Symbol symbol = p.symbols.concat(run.data(), run.size());     \
+            ExprPtr first = parts[run_start].expr;                              \
+            parts[run_start].expr = p.make<ConstString>(                        \
+                first->token, p.symbols.str(symbol), symbol);                   \
+            parts.resize(run_start + 1);                                        \
+            o.changed();                                                        \
+        }                                                                       \
+        run.clear()
+
+    for (std::size_t i = 0; i <= spine.size(); i++) {
+        Binop* joint = i == 0 ? nullptr : spine[spine.size() - i];
+        ExprPtr operand = joint ? joint->right : base;
+
+        // extend the current run of string constants
+        if (expr_is_const(operand) && is_ctype(operand->as<Const>(), EConstString)) {
+            if (run.empty())
+                run_start = parts.size();
+            run.push_back(e_to_val(operand, ConstString));
+            parts.push_back(ConcatPart { operand, joint });
+            continue;
+        }
+        concat_flush();
+
+        // numbers fold only while the chain so far is a single constant
+        if (parts.size() == 1 && expr_is_const(parts[0].expr) && expr_is_const(operand)) {
+            Const* combined = binop_resolve(p, joint,
+                parts[0].expr->as<Const>(), operand->as<Const>());
+            if (combined) {
+                parts[0].expr = combined;
+                o.changed();
+                continue;
+            }
+        }
+        parts.push_back(ConcatPart { operand, joint });
+    }
+    concat_flush();
+    #undef concat_flush
+
+    // relink what is left as a left deep chain
+    ExprPtr result = parts[0].expr;
+    for (std::size_t i = 1; i < parts.size(); i++) {
+        Binop* joint = parts[i].joint;
+        joint->left = result;
+        joint->right = parts[i].expr;
+        result = joint;
+    }
+    return result;
+}
+
+// fold operators whose operands are all constants
+static ExprPtr constant_fold(Optimizer& o, ExprPtr expr) {
+    switch (expr->type) {
         case EUnop: {
             Unop* op = expr->as<Unop>();
-            op->value = constant_fold(p, op->value);
             if (expr_is_const(op->value)) {
-                Const* combined = unary_resolve(p, op->token, op->value->as<Const>());
-                if (combined) {
-                    delete op;
+                Const* combined = unary_resolve(o.parser, op, op->value->as<Const>());
+                if (combined)
                     return combined;
-                }
             }
             return op;
         }
 
         case EBinop: {
             Binop* op = expr->as<Binop>();
-            op->left = constant_fold(p, op->left);
-            op->right = constant_fold(p, op->right);
+            if (op->op == OpAdd)
+                return fold_concat(o, op);
             if (expr_is_const(op->left) && expr_is_const(op->right)) {
-                Const* combined = binop_resolve(p, op->token,
+                Const* combined = binop_resolve(o.parser, op,
                     op->left->as<Const>(), op->right->as<Const>());
-                if (combined) {
-                    delete op;
+                if (combined)
                     return combined;
-                }
             }
             return op;
         }
 
-        case EReturn: {
-            Return* e = expr->as<Return>();
-            e->value = constant_fold(p, e->value);
-            return e;
+        default:
+            return expr;
+    }
+}
+
+// What is known of the value an expression evaluates to, if it does. A
+// pure expression evaluates without effects and cannot fail.
+#define FactNumber (1 << 0)
+#define FactInt    (1 << 1)
+#define FactNonNeg (1 << 2)
+#define FactFloat  (1 << 3)
+#define FactPure   (1 << 4)
+#define FactBool   (FactNumber | FactInt | FactNonNeg)
+#define FactMaxDepth 8
+
+#define has_facts(f, wanted) (((f) & (wanted)) == (wanted))
+
+// facts of an int the operator gives on operands known to be ints
+static inline int int_facts(OpKind op, int l, int r) {
+    switch (op) {
+        case OpBitAnd:
+            return FactNumber | FactInt | ((l | r) & FactNonNeg);
+        case OpBitOr:
+        case OpBitXor:
+            return FactNumber | FactInt | (l & r & FactNonNeg);
+        case OpShr:
+        case OpMod:
+            return FactNumber | FactInt | (l & FactNonNeg);
+        case OpDiv:
+            return FactNumber | FactInt | (l & r & FactNonNeg);
+        default:
+            return FactNumber | FactInt;
+    }
+}
+
+// what is known of an expression, looking at most depth levels down
+static int expr_facts(ExprPtr expr, int depth = 0) {
+    if (!expr || depth > FactMaxDepth)
+        return 0;
+
+    switch (expr->type) {
+        case EConst: {
+            Const* e = expr->as<Const>();
+            switch (e->const_type) {
+                case EConstInt:
+                    return FactNumber | FactInt | FactPure
+                        | (std::int64_t(e_to_val(e, ConstInt)) >= 0 ? FactNonNeg : 0);
+                case EConstFloat:
+                    return FactNumber | FactFloat | FactPure;
+                case EConstString:
+                case EConstNull:
+                    return FactPure;
+                // a declaration that never changes has the facts of its value
+                case EConstIdent: {
+                    Expr* decl = e->as<Var>()->decl;
+                    if (!decl)
+                        return 0;
+                    return FactPure | (decl->is(EConst) ? decl->as<Var>()->facts : 0);
+                }
+                default:
+                    return 0;
+            }
         }
 
-        case EFunction: {
-            Function* e = expr->as<Function>();
-            e->body = constant_fold(p, e->body);
-            return e;
+        // negation only works on numbers
+        case EUnop: {
+            const int value = expr_facts(expr->as<Unop>()->value, depth + 1);
+            return FactNumber | (value & (FactInt | FactFloat))
+                | (has_facts(value, FactNumber | FactPure) ? FactPure : 0);
         }
 
-        case EAssign: {
-            Assign* e = expr->as<Assign>();
-            e->value = constant_fold(p, e->value);
-            return e;
+        case EBinop: {
+            Binop* e = expr->as<Binop>();
+            const int l = expr_facts(e->left, depth + 1);
+            const int r = expr_facts(e->right, depth + 1);
+            const int pure = l & r & FactPure;
+            const bool ints = has_facts(l & r, FactInt);
+            const bool numbers = has_facts(l & r, FactNumber);
+
+            // arithmetic with a number only works on two numbers, and
+            // gives a float when either is one
+            const int arith = ((l | r) & FactNumber) | ((l | r) & FactFloat)
+                | (numbers ? pure : 0);
+
+            switch (e->op) {
+                // equality and truth work on any values
+                case OpEq:
+                case OpNe:
+                case OpAnd:
+                case OpOr:
+                    return FactBool | pure;
+                case OpGt:
+                case OpLt:
+                case OpGe:
+                case OpLe:
+                    return FactBool | (numbers ? pure : 0);
+                case OpAdd:
+                case OpSub:
+                case OpMul:
+                    return ints ? FactNumber | FactInt | pure : arith;
+                case OpDiv:
+                    return ints ? int_facts(e->op, l, r) : arith & ~FactPure;
+                case OpMod:
+                    return int_facts(e->op, l, r);
+                case OpShl:
+                case OpShr:
+                case OpBitAnd:
+                case OpBitXor:
+                case OpBitOr:
+                    return int_facts(e->op, l, r) | (ints ? pure : 0);
+                default:
+                    return 0;
+            }
         }
 
-        case ECall: {
-            std::vector<ExprPtr>& args = expr->as<Call>()->args;
-            const_fold_list(args, ExprPtr);
+        default:
+            return 0;
+    }
+}
+
+// constants an algebra rule matches
+typedef enum {
+    MatchZero,
+    MatchOne,
+    MatchPow2
+} AlgebraMatch;
+
+// what a matched operator is rewritten to
+typedef enum {
+    KeepOperand, // x
+    MakeZero,    // 0
+    MakeShl,     // x << k
+    MakeShr,     // x >> k
+    MakeMask     // x & (2^k - 1)
+} AlgebraAction;
+
+// x op c, or c op x too when the operator commutes, becomes action when
+// x has all the required facts
+struct AlgebraRule {
+    OpKind op;
+    bool commutes;
+    ConstExprType kind;
+    AlgebraMatch match;
+    int requires;
+    AlgebraAction action;
+};
+
+static const AlgebraRule algebra_rules[] = {
+    // identities, + 0 turns -0.0 into 0.0 so it is kept on floats
+    { OpAdd,    true,  EConstInt,   MatchZero, FactInt,              KeepOperand },
+    { OpSub,    false, EConstInt,   MatchZero, FactNumber,           KeepOperand },
+    { OpMul,    true,  EConstInt,   MatchOne,  FactNumber,           KeepOperand },
+    { OpDiv,    false, EConstInt,   MatchOne,  FactNumber,           KeepOperand },
+    { OpBitOr,  true,  EConstInt,   MatchZero, FactInt,              KeepOperand },
+    { OpBitXor, true,  EConstInt,   MatchZero, FactInt,              KeepOperand },
+    { OpShl,    false, EConstInt,   MatchZero, FactInt,              KeepOperand },
+    { OpShr,    false, EConstInt,   MatchZero, FactInt,              KeepOperand },
+    { OpSub,    false, EConstFloat, MatchZero, FactFloat,            KeepOperand },
+    { OpMul,    true,  EConstFloat, MatchOne,  FactFloat,            KeepOperand },
+    { OpDiv,    false, EConstFloat, MatchOne,  FactFloat,            KeepOperand },
+    // annihilators drop x, so it must not fail or have effects
+    { OpMul,    true,  EConstInt,   MatchZero, FactInt | FactPure,   MakeZero },
+    { OpBitAnd, true,  EConstInt,   MatchZero, FactInt | FactPure,   MakeZero },
+    // strength reduction, division truncates so shifts and masks
+    // only match it on values that are not negative
+    { OpMul,    true,  EConstInt,   MatchPow2, FactInt,              MakeShl },
+    { OpDiv,    false, EConstInt,   MatchPow2, FactNonNeg,           MakeShr },
+    { OpMod,    false, EConstInt,   MatchPow2, FactNonNeg,           MakeMask },
+};
+
+// check if a constant is what a rule matches, k is its log2 for powers
+static inline bool algebra_match(const AlgebraRule& rule, Const* value, std::uint64_t& k) {
+    if (value->const_type != rule.kind)
+        return false;
+    if (rule.kind == EConstFloat) {
+        const double number = e_to_val(value, ConstFloat);
+        return number == (rule.match == MatchOne ? 1.0 : 0.0);
+    }
+
+    const std::uint64_t number = e_to_val(value, ConstInt);
+    switch (rule.match) {
+        case MatchZero: return number == 0;
+        case MatchOne: return number == 1;
+        default: break;
+    }
+    if (number < 2 || (number & (number - 1)) || std::int64_t(number) < 0)
+        return false;
+    for (k = 0; (std::uint64_t(1) << k) != number; k++);
+    return true;
+}
+
+// Fold the constants of a chain like (x + 1) - 2 or (x * 3) * 4 into one.
+// Ints wrap, so this is exact on them but not on floats.
+static ExprPtr reassociate(Parser& p, Binop* e) {
+    const bool adds = e->op == OpAdd || e->op == OpSub;
+    if ((!adds && e->op != OpMul) || !expr_is_const(e->right)
+        || !is_ctype(e->right->as<Const>(), EConstInt))
+        return e;
+
+    std::uint64_t total = e_to_val(e->right->as<Const>(), ConstInt);
+    if (e->op == OpSub)
+        total = 0 - total;
+
+    ExprPtr rest = e->left;
+    std::size_t merged = 0;
+    while (rest && rest->is(EBinop)) {
+        Binop* inner = rest->as<Binop>();
+        if (adds ? inner->op != OpAdd && inner->op != OpSub : inner->op != OpMul)
+            break;
+
+        // the constant may be on either side of a + or a *
+        ExprPtr constant = inner->right;
+        ExprPtr other = inner->left;
+        if (inner->op != OpSub && !(expr_is_const(constant)
+            && is_ctype(constant->as<Const>(), EConstInt)))
+            std::swap(constant, other);
+        if (!expr_is_const(constant) || !is_ctype(constant->as<Const>(), EConstInt))
+            break;
+
+        const std::uint64_t value = e_to_val(constant->as<Const>(), ConstInt);
+        if (!adds)
+            total *= value;
+        else
+            total += inner->op == OpSub ? 0 - value : value;
+        rest = other;
+        merged++;
+    }
+
+    if (merged == 0 || !has_facts(expr_facts(rest), FactInt))
+        return e;
+    return p.make<Binop>(e->token, adds ? OpAdd : OpMul, rest,
+        p.make<ConstInt>(e->right->token, total));
+}
+
+// Merge the constants of + and * chains, then rewrite operators with one
+// literal operand by the first rule of the table that matches. Locals
+// that are never assigned or aliased record what is known of their
+// value when declared, so the rules apply to names too.
+static ExprPtr algebra(Optimizer& o, ExprPtr expr) {
+    if (expr->is(EAssign)) {
+        Assign* e = expr->as<Assign>();
+        Var* var = e->vars.size() == 1 ? e->vars[0] : nullptr;
+        if (var && !(var->flags & (Var::Flag::Ref | Var::Flag::Assigned | Var::Flag::Escapes)))
+            var->facts = expr_facts(e->value) & ~FactPure;
+        return e;
+    }
+
+    if (!expr->is(EBinop))
+        return expr;
+    Parser& p = o.parser;
+    Binop* e = expr->as<Binop>();
+    ExprPtr merged = reassociate(p, e);
+    if (merged != e || !e->left || !e->right || is_literal(e->left) == is_literal(e->right))
+        return merged;
+
+    for (const AlgebraRule& rule : algebra_rules) {
+        if (rule.op != e->op)
+            continue;
+
+        ExprPtr operand = e->left;
+        ExprPtr constant = e->right;
+        if (rule.commutes && is_literal(operand))
+            std::swap(operand, constant);
+
+        std::uint64_t k = 0;
+        if (!is_literal(constant) || !algebra_match(rule, constant->as<Const>(), k)
+            || !has_facts(expr_facts(operand), rule.requires))
+            continue;
+
+        const Token& token = constant->token;
+        switch (rule.action) {
+            case KeepOperand:
+                return operand;
+            case MakeZero:
+                return p.make<ConstInt>(token, 0);
+            case MakeShl:
+                return p.make<Binop>(e->token, OpShl, operand, p.make<ConstInt>(token, k));
+            case MakeShr:
+                return p.make<Binop>(e->token, OpShr, operand, p.make<ConstInt>(token, k));
+            case MakeMask:
+                return p.make<Binop>(e->token, OpBitAnd, operand,
+                    p.make<ConstInt>(token, (std::uint64_t(1) << k) - 1));
+        }
+    }
+    return e;
+}
+
+// A switch keeps the cases a constant condition does not rule out. Once
+// a case always matches the ones after it are dead, and when that is
+// the first direct case of a switch on a literal only its body is left.
+static ExprPtr prune_switch(Optimizer& o, Switch* e) {
+    Parser& p = o.parser;
+    ArenaVec<Case*>& cases = e->cases;
+    std::size_t kept = 0;
+    int first = -1;
+
+    for (std::size_t i = 0; i < cases.size(); i++) {
+        CaseCondition* cond = cases[i]->condition;
+        const bool pure = !cond->value || expr_is_const(cond->value);
+        const int truth = const_truth(p, cond->condition);
+        if (truth == 0 && pure)
+            continue;
+
+        if (kept == 0)
+            first = cond->is_direct ? truth : -1;
+        cases[kept++] = cases[i];
+        if (truth == 1 && pure && (cond->is_direct || !cond->value || is_var(cond->value)))
+            break;
+    }
+
+    if (kept < cases.size()) {
+        cases.resize(kept);
+        o.changed();
+    }
+
+    if (!expr_is_const(e->value))
+        return e;
+    if (kept == 0)
+        return p.make<Const>(e->token, EConstNull);
+    if (first != 1)
+        return e;
+
+    // the body keeps the scope its case gave it
+    ExprPtr body = cases[0]->body;
+    if (!body)
+        return p.make<Const>(e->token, EConstNull);
+    if (body->is(EBlock) || body->is(EConst))
+        return body;
+    Block* block = p.make<Block>(body->token, p.arena);
+    block->body.push_back(body);
+    return block;
+}
+
+// copy of a literal at another position
+static inline Const* literal_copy(Parser& p, Const* value, const Token& token) {
+    switch (value->const_type) {
+        case EConstInt:
+            return p.make<ConstInt>(token, e_to_val(value, ConstInt));
+        case EConstFloat:
+            return p.make<ConstFloat>(token, e_to_val(value, ConstFloat));
+        case EConstString:
+            return p.make<ConstString>(token, e_to_val(value, ConstString),
+                value->as<ConstString>()->symbol);
+        default:
+            return p.make<Const>(token, value->const_type);
+    }
+}
+
+// A const declaration of one name bound to a literal is read as that
+// literal wherever it resolves to. Declarations are rewritten before the
+// statements after them, so every use sees its binding already folded.
+static ExprPtr const_propagate(Optimizer& o, ExprPtr expr) {
+    if (expr->is(EAssign)) {
+        Assign* e = expr->as<Assign>();
+        if (e->vars.size() == 1 && is_literal(e->value)
+            && (e->vars[0]->flags & (Var::Flag::Const | Var::Flag::Ref)) == Var::Flag::Const)
+            e->vars[0]->constant = e->value->as<Const>();
+        return e;
+    }
+
+    if (!is_var(expr))
+        return expr;
+    Var* use = expr->as<Var>();
+    if (!use->decl || use->decl == use || !use->decl->is(EConst))
+        return use;
+    Const* value = use->decl->as<Var>()->constant;
+    return value ? literal_copy(o.parser, value, use->token) : use;
+}
+
+// drop branches a constant condition never takes
+static ExprPtr dead_branches(Optimizer& o, ExprPtr expr) {
+    Parser& p = o.parser;
+    switch (expr->type) {
+        case EIf: {
+            If* e = expr->as<If>();
+            const int truth = const_truth(p, e->condition);
+            if (truth < 0)
+                return e;
+            ExprPtr taken = truth ? e->body : e->else_body;
+            return taken ? taken : p.make<Const>(e->token, EConstNull);
+        }
+
+        // 0 && x and 1 || x never evaluate x
+        case EBinop: {
+            Binop* e = expr->as<Binop>();
+            if (e->op != OpAnd && e->op != OpOr)
+                return e;
+            const int truth = const_truth(p, e->left);
+            if (truth < 0 || truth == (e->op == OpAnd))
+                return e;
+            return p.make<ConstInt>(e->token, std::uint64_t(truth));
+        }
+
+        case ESwitch:
+            return prune_switch(o, expr->as<Switch>());
+
+        default:
             return expr;
+    }
+}
+
+// point the operands of a direct case test at the new switch value
+static void relink(ExprPtr test, ExprPtr from, ExprPtr to) {
+    if (!test || !test->is(EBinop))
+        return;
+    Binop* op = test->as<Binop>();
+    if (op->left == from)
+        op->left = to;
+    else if (op->op == OpOr) {
+        relink(op->left, from, to);
+        relink(op->right, from, to);
+    }
+}
+
+// check if a name reads a local that only changes by assigning to it or
+// to an alias, not an alias itself
+static inline bool is_local(Var* use) {
+    return use->decl && use->decl->is(EConst)
+        && !(use->decl->as<Var>()->flags & Var::Flag::Ref);
+}
+
+// a local that may change after it is declared
+#define is_mutable(decl) \
+    ((decl)->as<Var>()->flags & (Var::Flag::Assigned | Var::Flag::Escapes))
+
+#define cse_mix(h, x) (((h) ^ std::size_t(x)) * std::size_t(0x100000001b3ULL))
+
+// Operator node reading only literals and locals. A guarded site
+// may not run, or runs in an inner scope, so it cannot declare the
+// temporary the later ones read.
+struct CseSite {
+    ExprPtr* link;
+    Switch* owner;        // switch whose value this is
+    std::size_t hash;
+    std::uint32_t size;   // nodes in the subtree
+    std::uint32_t start;  // first site inside it
+    bool guarded;
+};
+
+// Assignment to a local, or a call when decl is null, made after the
+// first pos sites were evaluated. Locals that escape may change at any.
+struct CseKill {
+    std::uint32_t pos;
+    Expr* decl;
+};
+
+// Sites of a block in evaluation order, each after the ones inside it.
+// Blocks nesting deeper than OptimizerMaxCseDepth are marked too deep
+// and left alone, which bounds the recursion here and when comparing.
+struct CseScan {
+    std::vector<CseSite> sites;
+    std::vector<CseKill> kills;
+    // switch value node shared by the direct case tests being scanned
+    ExprPtr shared = nullptr;
+    std::uint32_t depth = 0;
+    bool deep = false;
+
+    bool node(ExprPtr* link, bool guarded, std::size_t& hash, std::uint32_t& size);
+
+    bool scan(ExprPtr* link, bool guarded, std::size_t& hash, std::uint32_t& size) {
+        if (depth == OptimizerMaxCseDepth) {
+            deep = true;
+            return false;
+        }
+        depth++;
+        const bool pure = node(link, guarded, hash, size);
+        depth--;
+        return pure;
+    }
+
+    void scan(ExprPtr* link, bool guarded) {
+        std::size_t hash;
+        std::uint32_t size;
+        scan(link, guarded, hash, size);
+    }
+};
+
+// Hash the subtree at link and record its operator nodes, false when it
+// does more than read literals and locals.
+bool CseScan::node(ExprPtr* link, bool guarded, std::size_t& hash, std::uint32_t& size) {
+    ExprPtr expr = *link;
+    if (!expr || expr == shared)
+        return false;
+
+    hash = cse_mix(std::size_t(0xcbf29ce484222325ULL), expr->type);
+    size = 1;
+    switch (expr->type) {
+        case EConst: {
+            Const* e = expr->as<Const>();
+            hash = cse_mix(hash, e->const_type);
+            switch (e->const_type) {
+                case EConstInt:
+                    hash = cse_mix(hash, e_to_val(e, ConstInt));
+                    return true;
+                case EConstFloat: {
+                    std::uint64_t bits;
+                    std::memcpy(&bits, &e_to_val(e, ConstFloat), sizeof(bits));
+                    hash = cse_mix(hash, bits);
+                    return true;
+                }
+                case EConstString:
+                    hash = cse_mix(hash, Interner::hash(e_to_val(e, ConstString)));
+                    return true;
+                case EConstNull:
+                    return true;
+                case EConstIdent:
+                    hash = cse_mix(hash, std::uintptr_t(e->as<Var>()->decl));
+                    return is_local(e->as<Var>());
+                default:
+                    return false;
+            }
+        }
+
+        case EUnop: {
+            Unop* e = expr->as<Unop>();
+            const std::uint32_t start = std::uint32_t(sites.size());
+            std::size_t value_hash;
+            std::uint32_t value_size;
+            if (!scan(&e->value, guarded, value_hash, value_size))
+                return false;
+            hash = cse_mix(cse_mix(hash, e->op), value_hash);
+            size += value_size;
+            sites.push_back(CseSite { link, nullptr, hash, size, start, guarded });
+            return true;
+        }
+
+        case EBinop: {
+            Binop* e = expr->as<Binop>();
+            switch (e->op) {
+                // an assigned name is not read
+                case OpAssign:
+                case OpUpdate:
+                    if (!is_var(e->left))
+                        scan(&e->left, guarded);
+                    scan(&e->right, guarded);
+                    if (is_var(e->left) && e->left->as<Var>()->decl)
+                        kills.push_back(CseKill { std::uint32_t(sites.size()), e->left->as<Var>()->decl });
+                    return false;
+                case OpDot:
+                case OpArrow:
+                case OpSpread:
+                case OpNone:
+                    scan(&e->left, guarded);
+                    return false;
+                default:
+                    break;
+            }
+
+            const std::uint32_t start = std::uint32_t(sites.size());
+            std::size_t left_hash, right_hash;
+            std::uint32_t left_size, right_size;
+            const bool left = scan(&e->left, guarded, left_hash, left_size);
+            const bool right = scan(&e->right,
+                guarded || e->op == OpAnd || e->op == OpOr, right_hash, right_size);
+            if (!left || !right)
+                return false;
+            hash = cse_mix(cse_mix(cse_mix(hash, e->op), left_hash), right_hash);
+            size += left_size + right_size;
+            sites.push_back(CseSite { link, nullptr, hash, size, start, guarded });
+            return true;
+        }
+
+        case EReturn:
+            scan(&expr->as<Return>()->value, guarded);
+            return false;
+
+        case ECall: {
+            ArenaVec<ExprPtr>& args = expr->as<Call>()->args;
+            for (std::size_t i = 0; i < args.size(); i++)
+                scan(&args[i], guarded);
+            kills.push_back(CseKill { std::uint32_t(sites.size()), nullptr });
+            return false;
+        }
+
+        case EAssign:
+            scan(&expr->as<Assign>()->value, guarded);
+            return false;
+
+        case EIf: {
+            If* e = expr->as<If>();
+            scan(&e->condition, guarded);
+            scan(&e->body, true);
+            scan(&e->else_body, true);
+            return false;
         }
 
+        case ESwitch: {
+            Switch* e = expr->as<Switch>();
+            // direct case tests share the value node and their scopes
+            // resolve it again, so it cannot declare a temporary
+            const std::size_t value_site = sites.size();
+            scan(&e->value, true);
+            if (sites.size() > value_site && sites.back().link == &e->value)
+                sites.back().owner = e;
+
+            ExprPtr saved = shared;
+            for (Case* c : e->cases) {
+                CaseCondition* cond = c->condition;
+                shared = cond->is_direct ? e->value : nullptr;
+                if (!cond->is_direct && cond->value && !is_var(cond->value))
+                    scan(&cond->value, true);
+                scan(&cond->condition, true);
+                shared = saved;
+                scan(&c->body, true);
+            }
+            return false;
+        }
+
+        // names of an inner block are not visible after it
         case EBlock: {
-            std::vector<ExprPtr>& body = expr->as<Block>()->body;
-            const_fold_list(body, ExprPtr);
-            return expr;
+            ArenaVec<ExprPtr>& body = expr->as<Block>()->body;
+            for (std::size_t i = 0; i < body.size(); i++)
+                scan(&body[i], true);
+            return false;
+        }
+
+        // function bodies run later, in their own frame
+        default:
+            return false;
+    }
+}
+
+// structural equality of two subtrees a scan accepted
+static bool cse_equal(ExprPtr a, ExprPtr b) {
+    if (a == b)
+        return true;
+    if (a->type != b->type)
+        return false;
+
+    switch (a->type) {
+        case EConst: {
+            Const* x = a->as<Const>();
+            Const* y = b->as<Const>();
+            if (x->const_type != y->const_type)
+                return false;
+            switch (x->const_type) {
+                case EConstInt:
+                    return e_to_val(x, ConstInt) == e_to_val(y, ConstInt);
+                case EConstFloat:
+                    return !std::memcmp(&e_to_val(x, ConstFloat), &e_to_val(y, ConstFloat), sizeof(double));
+                case EConstString:
+                    return e_to_val(x, ConstString) == e_to_val(y, ConstString);
+                case EConstIdent:
+                    return x->as<Var>()->decl == y->as<Var>()->decl;
+                default:
+                    return true;
+            }
+        }
+        case EUnop:
+            return a->as<Unop>()->op == b->as<Unop>()->op
+                && cse_equal(a->as<Unop>()->value, b->as<Unop>()->value);
+        case EBinop:
+            return a->as<Binop>()->op == b->as<Binop>()->op
+                && cse_equal(a->as<Binop>()->left, b->as<Binop>()->left)
+                && cse_equal(a->as<Binop>()->right, b->as<Binop>()->right);
+        default:
+            return false;
+    }
+}
+
+// locals a subtree reads that may change
+static void cse_mutables(ExprPtr expr, std::vector<Expr*>& decls) {
+    switch (expr->type) {
+        case EConst:
+            if (expr->as<Const>()->const_type == EConstIdent && is_mutable(expr->as<Var>()->decl))
+                decls.push_back(expr->as<Var>()->decl);
+            break;
+        case EUnop:
+            cse_mutables(expr->as<Unop>()->value, decls);
+            break;
+        case EBinop:
+            cse_mutables(expr->as<Binop>()->left, decls);
+            cse_mutables(expr->as<Binop>()->right, decls);
+            break;
+        default:
+            break;
+    }
+}
+
+// check if any of the locals may change between two sites
+static bool cse_killed(const CseScan& scan, const std::vector<Expr*>& decls,
+    std::uint32_t from, std::uint32_t to)
+{
+    if (decls.empty())
+        return false;
+    auto kill = std::upper_bound(scan.kills.begin(), scan.kills.end(), from,
+        [](std::uint32_t pos, const CseKill& k) { return pos < k.pos; });
+    for (; kill != scan.kills.end() && kill->pos <= to; kill++) {
+        for (Expr* decl : decls)
+            if (kill->decl == decl || (decl->as<Var>()->flags & Var::Flag::Escapes))
+                return true;
+    }
+    return false;
+}
+
+// Repeated operator subtrees of a block are computed once. The first
+// site that is sure to run stores its result in a new const declared
+// in place, the sites after it read that instead until a local they
+// read may have changed. Larger subtrees are taken first, the sites
+// inside the ones that became reads are gone.
+static ExprPtr common_subexprs(Optimizer& o, ExprPtr expr) {
+    if (!expr->is(EBlock))
+        return expr;
+    Parser& p = o.parser;
+    Block* block = expr->as<Block>();
+
+    CseScan scan;
+    for (std::size_t i = 0; i < block->body.size() && !scan.deep; i++)
+        scan.scan(&block->body[i], false);
+    if (scan.deep)
+        return block;
+    std::vector<CseSite>& sites = scan.sites;
+
+    // group equal subtrees, each group in evaluation order
+    std::vector<std::uint32_t> order(sites.size());
+    for (std::uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return sites[a].hash < sites[b].hash;
+    });
+
+    std::vector<std::vector<std::uint32_t>> groups;
+    for (std::size_t i = 0; i < order.size(); ) {
+        std::size_t end = i + 1;
+        while (end < order.size() && sites[order[end]].hash == sites[order[i]].hash)
+            end++;
+        const std::size_t first_group = groups.size();
+        for (; i < end; i++) {
+            ExprPtr subtree = *sites[order[i]].link;
+            std::size_t g = first_group;
+            while (g < groups.size() && !cse_equal(*sites[groups[g][0]].link, subtree))
+                g++;
+            if (g == groups.size())
+                groups.emplace_back();
+            groups[g].push_back(order[i]);
+        }
+    }
+    std::stable_sort(groups.begin(), groups.end(),
+        [&](const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) {
+            return sites[a[0]].size > sites[b[0]].size;
+        });
+
+    std::vector<bool> gone(sites.size(), false);
+    std::vector<std::pair<std::uint32_t, Var*>> rewrites;
+    std::vector<Expr*> decls;
+    for (const std::vector<std::uint32_t>& group : groups) {
+        if (group.size() < 2)
+            continue;
+        decls.clear();
+        cse_mutables(*sites[group[0]].link, decls);
+
+        // each run of sites up to a change of what they read shares a
+        // temporary, declared by its first site that is sure to run
+        std::size_t i = 0;
+        while (i < group.size()) {
+            while (i < group.size() && (gone[group[i]] || sites[group[i]].guarded))
+                i++;
+            if (i == group.size())
+                break;
+
+            const std::uint32_t first = group[i];
+            Var* temp = nullptr;
+            for (i++; i < group.size() && !cse_killed(scan, decls, group[i - 1], group[i]); i++) {
+                const CseSite& site = sites[group[i]];
+                if (gone[group[i]])
+                    continue;
+                if (!temp) {
+                    const Symbol symbol = o.temporary();
+                    temp = p.make<Var>((*sites[first].link)->token, int(Var::Flag::Const),
+                        p.symbols.str(symbol), symbol);
+                    temp->decl = temp;
+                    rewrites.emplace_back(first, temp);
+                }
+                for (std::uint32_t inside = site.start; inside <= group[i]; inside++)
+                    gone[inside] = true;
+                rewrites.emplace_back(group[i], temp);
+                o.eliminated += site.size;
+            }
+        }
+    }
+
+    // declaring sites stay in the tree, so reads inside them keep their links
+    for (auto& rewrite : rewrites) {
+        const CseSite& site = sites[rewrite.first];
+        Var* temp = rewrite.second;
+        ExprPtr before = *site.link;
+
+        ExprPtr after;
+        if (gone[rewrite.first]) {
+            Var* read = p.make<Var>(before->token, 0, temp->name, temp->symbol);
+            read->decl = temp;
+            after = read;
+        } else {
+            Assign* assign = p.make<Assign>(before->token, before, p.arena);
+            assign->vars.push_back(temp);
+            after = assign;
         }
 
+        *site.link = after;
+        if (site.owner)
+            for (Case* c : site.owner->cases)
+                if (c->condition->is_direct)
+                    relink(c->condition->condition, before, after);
+    }
+
+    if (!rewrites.empty())
+        o.changed();
+    return block;
+}
+
+///////////////////////////////////////////////////////////////
+
+// every pass in its default pipeline order
+static const Pass optimizer_passes[] = {
+    Pass("const", const_propagate),
+    Pass("fold", constant_fold),
+    Pass("algebra", algebra),
+    Pass("branch", dead_branches),
+    Pass("cse", common_subexprs),
+};
+
+Optimizer::Optimizer(Parser& _parser)
+    : parser(_parser), passes(std::begin(optimizer_passes), std::end(optimizer_passes)) {}
+
+void Optimizer::select(const std::string& names) {
+    passes.clear();
+    std::size_t start = 0;
+    while (start <= names.size()) {
+        std::size_t end = names.find(',', start);
+        if (end == std::string::npos) end = names.size();
+        const std::string name = names.substr(start, end - start);
+        start = end + 1;
+        if (name.empty()) continue;
+
+        const Pass* found = nullptr;
+        for (const Pass& pass : optimizer_passes)
+            if (name == pass.name) found = &pass;
+        if (!found)
+            throw ParserError(sformat("Unknown optimizer pass %s", name.c_str()));
+        passes.push_back(*found);
+    }
+}
+
+// run the pipeline on one node until no pass changes it
+ExprPtr Optimizer::rewrite(ExprPtr expr) {
+    for (int round = 0; expr && round < OptimizerMaxRewrites; round++) {
+        bool changed = false;
+        for (Pass& pass : passes) {
+            const std::size_t before = edits;
+            ExprPtr result;
+            if (timing) {
+                auto start = std::chrono::steady_clock::now();
+                result = pass.rewrite(*this, expr);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                pass.seconds += elapsed.count();
+            } else {
+                result = pass.rewrite(*this, expr);
+            }
+
+            pass.visits++;
+            if (result != expr || edits != before) {
+                pass.changes++;
+                changed = true;
+                expr = result;
+                if (!expr) break;
+            }
+        }
+        if (!changed) break;
+    }
+    return expr;
+}
+
+// assignment to a name, which is not read
+#define is_store(e) \
+    (((e)->op == OpAssign || (e)->op == OpUpdate) && is_var((e)->left))
+
+#define visit_list(list, type) \
+    for (std::size_t i = 0; i < list.size(); i++) \
+        list[i] = static_cast<type>(visit(list[i]))
+
+// visit the children of a node, then rewrite the node itself
+ExprPtr Optimizer::visit(ExprPtr expr) {
+    if (!expr) return expr;
+    switch (expr->type) {
+
+        case EUnop:
+            visit(&expr->as<Unop>()->value);
+            break;
+
+        // Left deep chains like a * b + c are walked along their spine,
+        // rewriting each link as it unwinds. A + chain folds all its
+        // concatenations from its top, so they are not walked again at
+        // every level.
+        case EBinop: {
+            const std::size_t mark = spine.size();
+            for (ExprPtr link = expr; link && link->is(EBinop) && !is_store(link->as<Binop>());
+                    link = link->as<Binop>()->left)
+                spine.push_back(link->as<Binop>());
+
+            // an assigned name is not read
+            if (spine.size() == mark) {
+                visit(&expr->as<Binop>()->right);
+                break;
+            }
+
+            visit(&spine.back()->left);
+            for (std::size_t i = spine.size(); i > mark + 1; i--) {
+                visit(&spine[i - 1]->right);
+                chain_link = spine[i - 1]->op == OpAdd && spine[i - 2]->op == OpAdd;
+                spine[i - 2]->left = rewrite(spine[i - 1]);
+                chain_link = false;
+            }
+            visit(&spine[mark]->right);
+            spine.resize(mark);
+            break;
+        }
+
+        case EReturn:
+            visit(&expr->as<Return>()->value);
+            break;
+
+        case EFunction:
+            visit(&expr->as<Function>()->body);
+            break;
+
+        case EAssign:
+            visit(&expr->as<Assign>()->value);
+            break;
+
+        case ECall:
+            visit_list(expr->as<Call>()->args, ExprPtr);
+            break;
+
+        case EBlock: {
+            ArenaVec<ExprPtr>& body = expr->as<Block>()->body;
+            for (std::size_t i = 0; i < body.size(); i++)
+                visit(&body[i]);
+            break;
+        }
+
+        // direct cases test the switch value node itself, they are
+        // pointed at what it was rewritten to instead of rewriting a copy
         case ESwitch: {
-            std::vector<Case*>& cases = expr->as<Switch>()->cases;
-            const_fold_list(cases, Case*);
-            return expr;
+            Switch* e = expr->as<Switch>();
+            ExprPtr value = e->value;
+            visit(&e->value);
+            if (e->value != value)
+                for (Case* c : e->cases)
+                    if (c->condition->is_direct)
+                        relink(c->condition->condition, value, e->value);
+            visit_list(e->cases, Case*);
+            break;
         }
 
         case ECaseCond: {
             CaseCondition* e = expr->as<CaseCondition>();
-            e->value = constant_fold(p, e->value);
-            e->condition = constant_fold(p, e->condition);
-            return e;
+            visit(&e->value);
+            visit(&e->condition);
+            break;
         }
 
         case ECase: {
             Case* e = expr->as<Case>();
-            e->body = constant_fold(p, e->body);
-            e->condition = static_cast<CaseCondition*>(
-                constant_fold(p, e->condition));
-            return e;
+            e->condition = static_cast<CaseCondition*>(visit(e->condition));
+            visit(&e->body);
+            break;
+        }
+
+        case EIf: {
+            If* e = expr->as<If>();
+            visit(&e->condition);
+            visit(&e->body);
+            visit(&e->else_body);
+            break;
         }
 
         default:
-            return expr;
+            break;
     }
+    return rewrite(expr);
+}
+
+ExprPtr Optimizer::run(ExprPtr tree) {
+    return visit(tree);
+}
+
+void Optimizer::report() {
+    std::fprintf(stderr, "%-10s %10s %10s %10s\n", "pass", "visits", "changes", "seconds");
+    for (Pass& pass : passes) {
+        std::fprintf(stderr, "%-10s %10lu %10lu %10.4f\n",
+            pass.name, pass.visits, pass.changes, pass.seconds);
+        pass.visits = pass.changes = 0;
+        pass.seconds = 0;
+    }
+    std::fprintf(stderr, "%lu temporaries replaced %lu nodes\n", temporaries, eliminated);
+    temporaries = eliminated = 0;
+}
+
+Symbol Optimizer::temporary() {
+    temporaries++;
+    const std::string name = sformat("<cse%lu>", names++);
+    return parser.symbols.intern(StrView(name.data(), name.size()));
 }
 
 ExprPtr Compiler::optimize(ExprPtr tree) {
-    tree = constant_fold(parser, tree);
-    return tree;
-}
\ No newline at end of file
+    return optimizer.run(tree);
+}
+
+///////////////////////////////////////////////////////////////
+
+// check if a flat node index is a constant
+#define flat_const(ast, i) ((i) != FlatNull && (ast).nodes[i].type == EConst)
+
+// rewrite a node in place into a constant with a new payload
+template <typename T>
+static inline void flat_store(std::vector<T>& values, FlatNode& node, ConstExprType kind, const T& value) {
+    node.type = EConst;
+    node.kind = kind;
+    node.flags = 0;
+    node.a = std::uint32_t(values.size());
+    node.b = node.c = FlatNull;
+    values.push_back(value);
+}
+
+// rewrite a node in place into a folded number
+static inline void flat_number(FlatAst& ast, FlatNode& node, const Value& value) {
+    if (value.is(VInt))
+        flat_store(ast.ints, node, EConstInt, std::uint64_t(value.as_int()));
+    else
+        flat_store(ast.floats, node, EConstFloat, value.as_float());
+}
+
+// String being built by a chain of constant concatenations. Only the
+// newest node of the chain is pending, it is interned once the chain
+// ends instead of interning every intermediate string.
+struct FlatRope {
+    std::string text;
+    std::uint32_t node = FlatNull;
+
+    void flush(Parser& p, FlatAst& ast) {
+        if (node == FlatNull) return;
+        ast.strings[ast.nodes[node].a] = p.symbols.str(
+            p.symbols.intern(StrView(text.data(), text.size())));
+        node = FlatNull;
+    }
+};
+
+static inline void flat_concat(Parser& p, FlatAst& ast, std::uint32_t index, FlatRope& rope) {
+    FlatNode& node = ast.nodes[index];
+    if (node.b == rope.node)
+        rope.flush(p, ast);
+
+    // extend the pending string when this node continues its chain
+    if (node.a == rope.node) {
+        rope.text.append(ast.strings[ast.nodes[node.b].a].data, ast.strings[ast.nodes[node.b].a].size);
+    } else {
+        rope.flush(p, ast);
+        const StrView& left = ast.strings[ast.nodes[node.a].a];
+        rope.text.assign(left.data, left.size);
+        rope.text.append(ast.strings[ast.nodes[node.b].a].data, ast.strings[ast.nodes[node.b].a].size);
+    }
+
+    flat_store(ast.strings, node, EConstString, StrView());
+    rope.node = index;
+}
+
+// runtime value of a flat literal, false for names and this
+static inline bool flat_value(Parser& p, FlatAst& ast, const FlatNode& node, Value& out) {
+    switch (node.kind) {
+        case EConstInt:
+            out = Value::of_int(std::int64_t(ast.ints[node.a]), p.arena);
+            return true;
+        case EConstFloat:
+            out = Value::of_float(ast.floats[node.a]);
+            return true;
+        case EConstString:
+            out = Value::of_string(&ast.strings[node.a]);
+            return true;
+        case EConstNull:
+            out = Value();
+            return true;
+        default:
+            return false;
+    }
+}
+
+// fold comparisons and logic like compare_resolve, a pending concatenation
+// is interned first so its text can be compared
+static inline void flat_compare(Parser& p, FlatAst& ast, FlatNode& node, FlatRope& rope) {
+    if (node.a == rope.node || node.b == rope.node)
+        rope.flush(p, ast);
+
+    Value l, r, out;
+    if (!flat_value(p, ast, ast.nodes[node.a], l) || !flat_value(p, ast, ast.nodes[node.b], r))
+        return;
+
+    const OpKind op = OpKind(node.kind);
+    bool result;
+    if (op == OpAnd)
+        result = l.truthy() && r.truthy();
+    else if (op == OpOr)
+        result = l.truthy() || r.truthy();
+    else if (value_arith(op, l, r, p.arena, out) == ArithOk)
+        result = out.truthy();
+    else
+        return;
+    flat_store(ast.ints, node, EConstInt, std::uint64_t(result));
+}
+
+static inline void flat_binop(Parser& p, FlatAst& ast, FlatNode& node) {
+    const FlatNode& left = ast.nodes[node.a];
+    const FlatNode& right = ast.nodes[node.b];
+    const Token token(None, node.start);
+    const OpKind op = OpKind(node.kind);
+
+    const bool left_num = left.kind == EConstInt || left.kind == EConstFloat;
+    const bool right_num = right.kind == EConstInt || right.kind == EConstFloat;
+
+    // int op int, float op int, int op float, float op float
+    if (left_num && right_num) {
+        Value l, r;
+        flat_value(p, ast, left, l);
+        flat_value(p, ast, right, r);
+        flat_number(ast, node, const_arith(p, token, op, l, r));
+    }
+}
+
+static inline void flat_unary(Parser& p, FlatAst& ast, FlatNode& node) {
+    const FlatNode& value = ast.nodes[node.a];
+    const Token token(None, node.start);
+    const OpKind op = OpKind(node.kind);
+
+    switch (value.kind) {
+        case EConstInt:
+        case EConstFloat: {
+            Value number;
+            flat_value(p, ast, value, number);
+            flat_number(ast, node, const_negate(p, token, op, number));
+            break;
+        }
+        case EConstIdent:
+            break;
+        default:
+            p.error(token, "Invalid unary operator %s on constant expression",
+                Token::op_str(op));
+    }
+}
+
+// Children are stored before their parent, so one forward sweep folds the
+// tree bottom up. Folded nodes are rewritten in place and their operands
+// are left behind unreferenced.
+FlatAst& Compiler::optimize(FlatAst& ast) {
+    FlatRope rope;
+    for (std::uint32_t i = 0; i < ast.nodes.size(); i++) {
+        FlatNode& node = ast.nodes[i];
+        if (node.type == EUnop && flat_const(ast, node.a))
+            flat_unary(parser, ast, node);
+        else if (node.type != EBinop || !flat_const(ast, node.a) || !flat_const(ast, node.b))
+            continue;
+        else if (OpKind(node.kind) == OpAdd && ast.nodes[node.a].kind == EConstString
+            && ast.nodes[node.b].kind == EConstString)
+            flat_concat(parser, ast, i, rope);
+        else if (is_compare(OpKind(node.kind)) || OpKind(node.kind) == OpAnd || OpKind(node.kind) == OpOr)
+            flat_compare(parser, ast, node, rope);
+        else
+            flat_binop(parser, ast, node);
+    }
+    rope.flush(parser, ast);
+    return ast;
+}
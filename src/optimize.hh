@@ -0,0 +1,76 @@
+#pragma once
+
+#include "ast.hh"
+
+// times the pipeline may rewrite one node before moving on
+#define OptimizerMaxRewrites 8
+
+// nesting the cse pass walks into before it leaves a block alone
+#define OptimizerMaxCseDepth 4096
+
+class Optimizer;
+
+// one rewrite rule of the pipeline, applied to each node after its
+// children, returning the node that replaces it
+class Pass {
+public:
+    const char* name;
+    ExprPtr (*rewrite)(Optimizer& o, ExprPtr expr);
+
+    // how often the pass ran, how often it changed something and the
+    // time spent in it when the optimizer is timing
+    std::size_t visits = 0;
+    std::size_t changes = 0;
+    double seconds = 0;
+
+    Pass(const char* _name, ExprPtr (*_rewrite)(Optimizer&, ExprPtr))
+        : name(_name), rewrite(_rewrite) {}
+};
+
+// Runs the pipeline over a tree in one walk, bottom up, rewriting each
+// node until no pass changes it. Every pass only rewrites the node it
+// is given and what lies below it, so nothing needs a second visit.
+// The walk recurses into nested nodes, except along left deep operator
+// chains, which it follows in a loop however long they are.
+class Optimizer {
+private:
+    std::vector<Binop*> spine;
+    std::size_t edits = 0;
+    std::size_t names = 0;
+
+    ExprPtr visit(ExprPtr expr);
+    ExprPtr rewrite(ExprPtr expr);
+
+    inline void visit(ExprPtr* link) {
+        *link = visit(*link);
+    }
+
+public:
+    Parser& parser;
+    std::vector<Pass> passes;
+    bool timing = false;
+    // set while rewriting a + that is the left operand of another +
+    bool chain_link = false;
+    // compiler temporaries made and the nodes they saved evaluating
+    std::size_t temporaries = 0;
+    std::size_t eliminated = 0;
+
+    Optimizer(Parser& _parser);
+
+    // replace the pipeline with the comma separated passes in order
+    void select(const std::string& names);
+
+    ExprPtr run(ExprPtr tree);
+
+    // print the counters of the last runs and clear them
+    void report();
+
+    // record a change made in place by the running pass
+    inline void changed() {
+        edits++;
+    }
+
+    // intern a fresh name for a compiler temporary, spelled so that
+    // no identifier the lexer accepts can declare or shadow it
+    Symbol temporary();
+};
@@ -0,0 +1,187 @@
+#include "scan.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+std::size_t scan_scalar(const char*, std::size_t pos, std::size_t) {
+    return pos;
+}
+
+// line starts from pos to size one char at a time
+static inline void lines_from(const char* data, std::size_t pos,
+    std::size_t size, std::vector<std::size_t>& starts)
+{
+    for (; pos < size; pos++)
+        if (data[pos] == '\n')
+            starts.push_back(pos + 1);
+}
+
+static void lines_scalar(const char* data, std::size_t size, std::vector<std::size_t>& starts) {
+    lines_from(data, 0, size, starts);
+}
+
+#ifdef SCAN_X86
+
+///////////////////////////////////////////////////////////////
+// SSE2: 16 bytes per step
+
+#define SSE2 __attribute__((target("sse2")))
+
+// bytes of v within [lo, hi], bytes >= 0x80 compare negative and never match
+SSE2 static inline __m128i sse2_range(__m128i v, char lo, char hi) {
+    return _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+SSE2 static inline __m128i sse2_eq(__m128i v, char c) {
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+SSE2 static inline __m128i sse2_ident(__m128i v) {
+    __m128i alpha = sse2_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digit = sse2_range(v, '0', '9');
+    __m128i extra = _mm_or_si128(sse2_eq(v, '_'), sse2_eq(v, '$'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), extra);
+}
+
+SSE2 static inline __m128i sse2_space(__m128i v) {
+    return _mm_or_si128(sse2_eq(v, ' '),
+        _mm_or_si128(sse2_eq(v, '\t'), sse2_eq(v, '\r')));
+}
+
+SSE2 static inline __m128i sse2_numeric(__m128i v) {
+    return _mm_or_si128(sse2_range(v, '0', '9'), sse2_eq(v, '.'));
+}
+
+SSE2 static inline __m128i sse2_string(__m128i v) {
+    return _mm_xor_si128(sse2_eq(v, '"'), _mm_set1_epi8(-1));
+}
+
+template <__m128i (*Match)(__m128i)>
+SSE2 static std::size_t sse2_scan(const char* data, std::size_t pos, std::size_t size) {
+    while (pos + 16 <= size) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        unsigned mask = unsigned(_mm_movemask_epi8(Match(v)));
+        if (mask != 0xFFFFu)
+            return pos + __builtin_ctz(~mask);
+        pos += 16;
+    }
+    return pos;
+}
+
+SSE2 static void sse2_lines(const char* data, std::size_t size, std::vector<std::size_t>& starts) {
+    std::size_t pos = 0;
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        unsigned mask = unsigned(_mm_movemask_epi8(sse2_eq(v, '\n')));
+        for (; mask; mask &= mask - 1)
+            starts.push_back(pos + __builtin_ctz(mask) + 1);
+    }
+    lines_from(data, pos, size, starts);
+}
+
+///////////////////////////////////////////////////////////////
+// AVX2: 32 bytes per step
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_range(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+AVX2 static inline __m256i avx2_eq(__m256i v, char c) {
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+AVX2 static inline __m256i avx2_ident(__m256i v) {
+    __m256i alpha = avx2_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i digit = avx2_range(v, '0', '9');
+    __m256i extra = _mm256_or_si256(avx2_eq(v, '_'), avx2_eq(v, '$'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), extra);
+}
+
+AVX2 static inline __m256i avx2_space(__m256i v) {
+    return _mm256_or_si256(avx2_eq(v, ' '),
+        _mm256_or_si256(avx2_eq(v, '\t'), avx2_eq(v, '\r')));
+}
+
+AVX2 static inline __m256i avx2_numeric(__m256i v) {
+    return _mm256_or_si256(avx2_range(v, '0', '9'), avx2_eq(v, '.'));
+}
+
+AVX2 static inline __m256i avx2_string(__m256i v) {
+    return _mm256_xor_si256(avx2_eq(v, '"'), _mm256_set1_epi8(-1));
+}
+
+template <__m256i (*Match)(__m256i)>
+AVX2 static std::size_t avx2_scan(const char* data, std::size_t pos, std::size_t size) {
+    while (pos + 32 <= size) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        unsigned mask = unsigned(_mm256_movemask_epi8(Match(v)));
+        if (mask != 0xFFFFFFFFu)
+            return pos + __builtin_ctz(~mask);
+        pos += 32;
+    }
+    return pos;
+}
+
+AVX2 static void avx2_lines(const char* data, std::size_t size, std::vector<std::size_t>& starts) {
+    std::size_t pos = 0;
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        unsigned mask = unsigned(_mm256_movemask_epi8(avx2_eq(v, '\n')));
+        for (; mask; mask &= mask - 1)
+            starts.push_back(pos + __builtin_ctz(mask) + 1);
+    }
+    lines_from(data, pos, size, starts);
+}
+
+#endif // SCAN_X86
+
+///////////////////////////////////////////////////////////////
+
+static ScanKernels scan_kernels(ScanLevel level) {
+    switch (level) {
+#ifdef SCAN_X86
+        case ScanAVX2:
+            return { ScanAVX2, avx2_scan<avx2_ident>, avx2_scan<avx2_space>,
+                avx2_scan<avx2_numeric>, avx2_scan<avx2_string>, avx2_lines };
+        case ScanSSE2:
+            return { ScanSSE2, sse2_scan<sse2_ident>, sse2_scan<sse2_space>,
+                sse2_scan<sse2_numeric>, sse2_scan<sse2_string>, sse2_lines };
+#endif
+        default:
+            return { ScanScalar, scan_scalar, scan_scalar,
+                scan_scalar, scan_scalar, lines_scalar };
+    }
+}
+
+ScanLevel scan_detect() {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ScanAVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return ScanSSE2;
+#endif
+    return ScanScalar;
+}
+
+bool scan_use(ScanLevel level) {
+    if (level > scan_detect())
+        return false;
+    Scan = scan_kernels(level);
+    return true;
+}
+
+const char* scan_level_str(ScanLevel level) {
+    static const char* names[] = { "scalar", "sse2", "avx2" };
+    return names[level];
+}
+
+ScanKernels Scan = scan_kernels(scan_detect());
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// Vector kernels for long token runs. A kernel starts at pos and returns
+// the index of the first char that ends the run, or stops less than one
+// vector width before size and leaves the tail to the caller's scalar loop.
+typedef std::size_t (*ScanKernel)(const char* data, std::size_t pos, std::size_t size);
+
+// appends the offset following every '\n' in data
+typedef void (*LineKernel)(const char* data, std::size_t size, std::vector<std::size_t>& starts);
+
+typedef enum {
+    ScanScalar = 0,
+    ScanSSE2   = 1,
+    ScanAVX2   = 2
+} ScanLevel;
+
+// kernel set selected for the running cpu
+class ScanKernels {
+public:
+    ScanLevel level;
+    ScanKernel ident;   // [a-zA-Z0-9_$]
+    ScanKernel space;   // ' ', '\t', '\r'
+    ScanKernel numeric; // [0-9.]
+    ScanKernel string;  // anything but '"'
+    LineKernel lines;   // line starts of a whole source
+};
+
+// kernels used by the lexer
+extern ScanKernels Scan;
+
+// runs shorter than this never leave the scalar loop
+#define ScanThreshold 16
+
+// scalar fallback, leaves the whole run to the caller's own loop
+std::size_t scan_scalar(const char* data, std::size_t pos, std::size_t size);
+
+// best level the cpu supports
+ScanLevel scan_detect();
+
+// switch kernels, false if the cpu lacks the level
+bool scan_use(ScanLevel level);
+
+const char* scan_level_str(ScanLevel level);
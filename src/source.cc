@@ -0,0 +1,97 @@
+#include "ast.hh"
+#include "scan.hh"
+
+#include <algorithm>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+void LineIndex::build(const StrView& code) {
+    starts.clear();
+    starts.push_back(0);
+    Scan.lines(code.data, code.size, starts);
+}
+
+std::size_t LineIndex::line(std::size_t offset) const {
+    return std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin();
+}
+
+Source::~Source() {
+    close();
+}
+
+void Source::close() {
+    if (mapped && data)
+        munmap(const_cast<char*>(data), size);
+    buffer.clear();
+    lines.starts.clear();
+    mapped = false;
+    data = nullptr;
+    size = 0;
+}
+
+// read everything from a non-mappable descriptor (pipes, terminals)
+static inline void read_all(int fd, std::string& buffer) {
+    char chunk[1 << 16];
+    ssize_t count;
+    while ((count = ::read(fd, chunk, sizeof(chunk))) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw ParserError(sformat("Could not read: %s", std::strerror(errno)));
+        }
+        buffer.append(chunk, count);
+    }
+}
+
+Source& Source::open(const std::string& path) {
+    close();
+    const bool from_stdin = path == "-";
+    file = from_stdin ? "<stdin>" : path;
+
+    int fd = from_stdin ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw ParserError(sformat("Could not open %s: %s",
+            path.c_str(), std::strerror(errno)));
+
+    // map regular files directly, the lexer works off the mapping
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* region = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (region != MAP_FAILED) {
+            madvise(region, info.st_size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(region);
+            size = info.st_size;
+            mapped = true;
+        }
+    }
+
+    // fallback to buffering the input when it can't be mapped
+    if (!mapped) {
+        try {
+            read_all(fd, buffer);
+        } catch (...) {
+            if (!from_stdin) ::close(fd);
+            throw;
+        }
+        data = buffer.data();
+        size = buffer.size();
+    }
+
+    if (!from_stdin)
+        ::close(fd);
+    lines.build(view());
+    return *this;
+}
+
+Source& Source::assign(const std::string& filename, const std::string& code) {
+    close();
+    file = filename;
+    buffer = code;
+    data = buffer.data();
+    size = buffer.size();
+    lines.build(view());
+    return *this;
+}
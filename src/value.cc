@@ -0,0 +1,161 @@
+#include "value.hh"
+
+#include <algorithm>
+
+static const char* value_type_map[] = {
+    "null", "int", "float", "string", "function"
+};
+
+const char* Value::type_str(ValueType type) {
+    return value_type_map[type];
+}
+
+bool Value::truthy() const {
+    switch (type()) {
+        case VInt: return as_int() != 0;
+        case VFloat: return as_float() != 0.0;
+        case VString: return as_string()->size > 0;
+        case VFunction: return true;
+        default: return false;
+    }
+}
+
+bool Value::equals(const Value& other) const {
+    if (is_number() && other.is_number()) {
+        if (is(VInt) && other.is(VInt))
+            return as_int() == other.as_int();
+        return as_number() == other.as_number();
+    }
+
+    if (type() != other.type())
+        return false;
+
+    switch (type()) {
+        case VString: return *as_string() == *other.as_string();
+        case VFunction: return as_closure() == other.as_closure();
+        default: return true;
+    }
+}
+
+void Value::print() const {
+    switch (type()) {
+        case VInt:
+            std::printf("%ld", as_int());
+            break;
+        case VFloat:
+            std::printf("%g", as_float());
+            break;
+        case VString:
+            std::printf("%.*s", (int)as_string()->size, as_string()->data);
+            break;
+        case VFunction: {
+            const StrView& name = as_closure()->function->name;
+            std::printf("[func%s%.*s]", name.size > 0 ? " " : "", (int)name.size, name.data);
+            break;
+        }
+        default:
+            std::printf("null");
+            break;
+    }
+}
+
+Value Value::of_big_int(std::int64_t value, Arena& heap) {
+    return box(TagBigInt, heap.make<std::int64_t>(value));
+}
+
+///////////////////////////////////////////////////////////////
+
+// apply a comparison operator
+template <typename T>
+static inline bool compare(OpKind op, const T& left, const T& right) {
+    switch (op) {
+        case OpGt: return left > right;
+        case OpLt: return left < right;
+        case OpGe: return left >= right;
+        case OpLe: return left <= right;
+        case OpEq: return left == right;
+        default: return left != right;
+    }
+}
+
+// order of two strings as -1, 0 or 1
+static inline int str_order(const StrView& left, const StrView& right) {
+    const int cmp = std::memcmp(left.data, right.data, std::min(left.size, right.size));
+    if (cmp) return cmp < 0 ? -1 : 1;
+    return left.size < right.size ? -1 : left.size > right.size ? 1 : 0;
+}
+
+// store the result of an operator and report success
+#define arith_result(value) \
+    do { out = (value); return ArithOk; } while (0)
+
+ArithStatus value_arith(OpKind op, const Value& left, const Value& right, Arena& heap, Value& out) {
+    // int op int, wrapping on overflow
+    if (left.is(VInt) && right.is(VInt)) {
+        const std::int64_t l = left.as_int();
+        const std::int64_t r = right.as_int();
+        const std::uint64_t ul = std::uint64_t(l);
+        const std::uint64_t ur = std::uint64_t(r);
+
+        if (is_compare(op))
+            arith_result(Value::of_bool(compare(op, l, r)));
+
+        switch (op) {
+            case OpAdd: arith_result(Value::of_int(std::int64_t(ul + ur), heap));
+            case OpSub: arith_result(Value::of_int(std::int64_t(ul - ur), heap));
+            case OpMul: arith_result(Value::of_int(std::int64_t(ul * ur), heap));
+            case OpDiv:
+            case OpMod:
+                if (r == 0)
+                    return ArithDivZero;
+                if (r == -1)
+                    arith_result(Value::of_int(op == OpDiv ? std::int64_t(0 - ul) : 0, heap));
+                arith_result(Value::of_int(op == OpDiv ? l / r : l % r, heap));
+            case OpShl: arith_result(Value::of_int(std::int64_t(ul << (ur & 63)), heap));
+            case OpShr: arith_result(Value::of_int(l >> (ur & 63), heap));
+            case OpBitAnd: arith_result(Value::of_int(l & r, heap));
+            case OpBitXor: arith_result(Value::of_int(l ^ r, heap));
+            case OpBitOr: arith_result(Value::of_int(l | r, heap));
+            default: break;
+        }
+    }
+
+    // float op int, int op float, float op float
+    else if (left.is_number() && right.is_number()) {
+        const double l = left.as_number();
+        const double r = right.as_number();
+
+        if (is_compare(op))
+            arith_result(Value::of_bool(compare(op, l, r)));
+
+        switch (op) {
+            case OpAdd: arith_result(Value::of_float(l + r));
+            case OpSub: arith_result(Value::of_float(l - r));
+            case OpMul: arith_result(Value::of_float(l * r));
+            case OpDiv: arith_result(Value::of_float(l / r));
+            default: break;
+        }
+    }
+
+    // string op string
+    else if (left.is(VString) && right.is(VString)) {
+        const StrView& l = *left.as_string();
+        const StrView& r = *right.as_string();
+
+        if (is_compare(op))
+            arith_result(Value::of_bool(compare(op, str_order(l, r), 0)));
+
+        if (op == OpAdd) {
+            char* data = static_cast<char*>(heap.alloc(l.size + r.size, 1));
+            std::memcpy(data, l.data, l.size);
+            std::memcpy(data + l.size, r.data, r.size);
+            arith_result(Value::of_string(heap.make<StrView>(data, l.size + r.size)));
+        }
+    }
+
+    // any other types only compare for equality
+    if (op == OpEq || op == OpNe)
+        arith_result(Value::of_bool(left.equals(right) == (op == OpEq)));
+
+    return ArithInvalid;
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "ast.hh"
+
+// runtime value types
+typedef enum {
+    VNull     = 0,
+    VInt      = 1,
+    VFloat    = 2,
+    VString   = 3,
+    VFunction = 4
+} ValueType;
+
+class Frame;
+class Proto;
+
+// function value, its body runs with env as the parent frame,
+// proto is its compiled body when run by the vm
+class Closure {
+public:
+    Function* function;
+    Frame* env;
+    const Proto* proto;
+    Closure(Function* _function, Frame* _env, const Proto* _proto = nullptr)
+        : function(_function), env(_env), proto(_proto) {}
+};
+
+// NaN boxing: doubles are stored as they are and every other value
+// lives in the payload of a negative quiet NaN, with the kind in bits
+// 48-50. Real NaNs are canonicalized to the positive quiet NaN so they
+// never collide. Ints up to 48 bits are stored inline and wider ones
+// are boxed on the heap, pointers use the low 48 bits.
+#define ValueBoxMask   0xFFF8000000000000ull
+#define ValueTagShift  48
+#define ValuePayload   0x0000FFFFFFFFFFFFull
+#define ValueNaN       0x7FF8000000000000ull
+#define ValueSmallMin  (-(std::int64_t(1) << 47))
+#define ValueSmallMax  ((std::int64_t(1) << 47) - 1)
+
+typedef enum {
+    TagNull    = 1,
+    TagInt     = 2,
+    TagBigInt  = 3,
+    TagString  = 4,
+    TagClosure = 5
+} ValueTag;
+
+#define value_boxed(tag) \
+    (ValueBoxMask | (std::uint64_t(tag) << ValueTagShift))
+
+// value of the interpreter, only built and read through the
+// accessors so the representation can change underneath
+class Value {
+private:
+    std::uint64_t bits;
+
+    static inline Value from_bits(std::uint64_t bits) {
+        Value v; v.bits = bits; return v;
+    }
+
+    static inline Value box(ValueTag tag, const void* pointer) {
+        return from_bits(value_boxed(tag) | reinterpret_cast<std::uintptr_t>(pointer));
+    }
+
+    inline std::uint64_t tag() const {
+        return bits >> ValueTagShift;
+    }
+
+    inline const void* pointer() const {
+        return reinterpret_cast<const void*>(std::uintptr_t(bits & ValuePayload));
+    }
+
+    static Value of_big_int(std::int64_t value, Arena& heap);
+
+public:
+    Value() : bits(value_boxed(TagNull)) {}
+
+    // ints too wide for the payload are allocated in heap
+    static inline Value of_int(std::int64_t value, Arena& heap) {
+        if (value < ValueSmallMin || value > ValueSmallMax)
+            return of_big_int(value, heap);
+        return of_small(value);
+    }
+
+    // int known to fit in 48 bits
+    static inline Value of_small(std::int64_t value) {
+        return from_bits(value_boxed(TagInt) | (std::uint64_t(value) & ValuePayload));
+    }
+
+    // the language has no booleans, truth values are the ints 0 and 1
+    static inline Value of_bool(bool value) {
+        return of_small(value);
+    }
+
+    static inline Value of_float(double value) {
+        if (value != value)
+            return from_bits(ValueNaN);
+        Value v;
+        std::memcpy(&v.bits, &value, sizeof(double));
+        return v;
+    }
+
+    static inline Value of_string(const StrView* value) {
+        return box(TagString, value);
+    }
+
+    static inline Value of_closure(const Closure* value) {
+        return box(TagClosure, value);
+    }
+
+    inline ValueType type() const {
+        if ((bits & ValueBoxMask) != ValueBoxMask)
+            return VFloat;
+        switch (tag() & 7) {
+            case TagInt:
+            case TagBigInt: return VInt;
+            case TagString: return VString;
+            case TagClosure: return VFunction;
+            default: return VNull;
+        }
+    }
+
+    inline bool is(ValueType t) const { return type() == t; }
+    inline bool is_number() const { return is(VInt) || is(VFloat); }
+
+    // inline int, the fast path of arithmetic
+    inline bool is_small() const {
+        return tag() == (value_boxed(TagInt) >> ValueTagShift);
+    }
+
+    inline std::int64_t as_small() const {
+        return std::int64_t(bits << 16) >> 16;
+    }
+
+    inline std::int64_t as_int() const {
+        return is_small() ? as_small() : *static_cast<const std::int64_t*>(pointer());
+    }
+
+    inline double as_float() const {
+        double value;
+        std::memcpy(&value, &bits, sizeof(double));
+        return value;
+    }
+
+    inline const StrView* as_string() const {
+        return static_cast<const StrView*>(pointer());
+    }
+
+    inline const Closure* as_closure() const {
+        return static_cast<const Closure*>(pointer());
+    }
+
+    // int or float widened to a double
+    inline double as_number() const {
+        return is(VInt) ? double(as_int()) : as_float();
+    }
+
+    static const char* type_str(ValueType type);
+    bool truthy() const;
+    bool equals(const Value& other) const;
+    void print() const;
+};
+
+static_assert(sizeof(Value) == 8, "values are one word");
+
+// outcome of applying an operator to two values
+typedef enum {
+    ArithOk      = 0,
+    ArithInvalid = 1,
+    ArithDivZero = 2
+} ArithStatus;
+
+#define is_compare(op) ((op) >= OpGt && (op) <= OpNe)
+
+// apply a binary operator to two values, strings are allocated in heap
+ArithStatus value_arith(OpKind op, const Value& left, const Value& right, Arena& heap, Value& out);
+
+// slots of one function call, parent is the frame the function was
+// created in so (depth, slot) addresses walk up parent links
+class Frame {
+public:
+    Frame* parent;
+    Value* slots;
+    Frame(Frame* _parent, Value* _slots) : parent(_parent), slots(_slots) {}
+};
@@ -0,0 +1,316 @@
+#include "bytecode.hh"
+
+#include <algorithm>
+
+// computed goto is a gcc and clang extension
+#if defined(__GNUC__) && !defined(RATH_SWITCH_DISPATCH)
+#define VMComputedGoto 1
+#else
+#define VMComputedGoto 0
+#endif
+
+VM::VM(Parser& _parser) : parser(_parser), stack(VMStack), calls(VMMaxCalls) {}
+
+void VM::error(const CallInfo* ci, const Instr* pc, const std::string& message) {
+    const std::size_t index = pc - ci->proto->code.data();
+    parser.error(Token(None, ci->proto->offsets[index]), "%s", message.c_str());
+}
+
+Value VM::arith(const CallInfo* ci, const Instr* pc, OpKind op,
+    const Value& left, const Value& right)
+{
+    Value value;
+    switch (value_arith(op, left, right, heap, value)) {
+        case ArithDivZero:
+            error(ci, pc, "Division by zero");
+            break;
+        case ArithInvalid:
+            error(ci, pc, sformat("Invalid operator %s on %s and %s", Token::op_str(op),
+                Value::type_str(left.type()), Value::type_str(right.type())));
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+// int a switch key compares equal to, floats only when integral
+static inline bool dispatch_key(const Value& value, std::int64_t& key) {
+    if (value.is(VInt)) {
+        key = value.as_int();
+        return true;
+    }
+    if (!value.is(VFloat))
+        return false;
+    const double number = value.as_float();
+    if (!(number >= -9223372036854775808.0 && number < 9223372036854775808.0))
+        return false;
+    key = std::int64_t(number);
+    return double(key) == number;
+}
+
+#define vm_truthy(value) \
+    ((value).is_small() ? (value).as_small() != 0 : (value).truthy())
+
+// inline ints take the fast path, everything else goes through value_arith
+#define vm_binop(name, kind, result)                            \
+    vm_op(name) {                                               \
+        const Value& l = R[i.b];                                \
+        const Value& r = R[i.c];                                \
+        if (l.is_small() && r.is_small()) {                     \
+            const std::int64_t x = l.as_small();                \
+            const std::int64_t y = r.as_small();                \
+            R[i.a] = result;                                    \
+        } else {                                                \
+            R[i.a] = arith(ci, pc - 1, kind, l, r);             \
+        }                                                       \
+        vm_dispatch();                                          \
+    }
+
+#define vm_arith(name, kind)                                    \
+    vm_op(name) {                                               \
+        R[i.a] = arith(ci, pc - 1, kind, R[i.b], R[i.c]);       \
+        vm_dispatch();                                          \
+    }
+
+#define vm_wrap(x, op, y) \
+    Value::of_int(std::int64_t(std::uint64_t(x) op std::uint64_t(y)), heap)
+
+Value VM::run(const Program& program) {
+    const Proto* main = program.main;
+    if (main->registers > stack.size())
+        parser.error(Token(), "Stack overflow%s", "");
+
+    CallInfo* ci = calls.data();
+    CallInfo* const last = ci + calls.size() - 1;
+    ci->proto = main;
+    ci->regs = stack.data();
+    ci->stack_top = ci->regs + main->registers;
+    ci->local = Frame(nullptr, ci->regs);
+    ci->frame = &ci->local;
+    std::fill(ci->regs, ci->stack_top, Value());
+
+    Value* R = ci->regs;
+    const Value* K = main->constants.data();
+    const Instr* code = main->code.data();
+    const Instr* pc = code;
+    Instr i;
+
+#if VMComputedGoto
+#define bytecode_label(name, op) &&op_##name,
+    static const void* const labels[] = {
+        BytecodeOps(bytecode_label)
+    };
+#undef bytecode_label
+#define vm_op(name) op_##name:
+#define vm_dispatch() do { i = *pc++; goto *labels[i.op]; } while (0)
+    vm_dispatch();
+#else
+#define vm_op(name) case Bc##name:
+#define vm_dispatch() goto dispatch
+    dispatch:
+    i = *pc++;
+    switch (i.op) {
+#endif
+
+    vm_op(Move) {
+        R[i.a] = R[i.b];
+        vm_dispatch();
+    }
+
+    vm_op(LoadK) {
+        R[i.a] = K[i.b];
+        vm_dispatch();
+    }
+
+    vm_op(LoadNull) {
+        R[i.a] = Value();
+        vm_dispatch();
+    }
+
+    vm_op(GetUp) {
+        Frame* frame = ci->frame;
+        for (std::uint16_t depth = i.b; depth > 0; depth--)
+            frame = frame->parent;
+        R[i.a] = frame->slots[i.c];
+        vm_dispatch();
+    }
+
+    vm_op(SetUp) {
+        Frame* frame = ci->frame;
+        for (std::uint16_t depth = i.b; depth > 0; depth--)
+            frame = frame->parent;
+        frame->slots[i.c] = R[i.a];
+        vm_dispatch();
+    }
+
+    vm_binop(Add, OpAdd, vm_wrap(x, +, y))
+    vm_binop(Sub, OpSub, vm_wrap(x, -, y))
+    vm_binop(Mul, OpMul, vm_wrap(x, *, y))
+    vm_arith(Div, OpDiv)
+    vm_arith(Mod, OpMod)
+    vm_binop(Shl, OpShl, vm_wrap(x, <<, y & 63))
+    vm_binop(Shr, OpShr, Value::of_small(x >> (y & 63)))
+    vm_binop(BitAnd, OpBitAnd, Value::of_small(x & y))
+    vm_binop(BitXor, OpBitXor, Value::of_small(x ^ y))
+    vm_binop(BitOr, OpBitOr, Value::of_small(x | y))
+    vm_binop(Eq, OpEq, Value::of_bool(x == y))
+    vm_binop(Ne, OpNe, Value::of_bool(x != y))
+    vm_binop(Lt, OpLt, Value::of_bool(x < y))
+    vm_binop(Le, OpLe, Value::of_bool(x <= y))
+    vm_binop(Gt, OpGt, Value::of_bool(x > y))
+    vm_binop(Ge, OpGe, Value::of_bool(x >= y))
+
+    vm_op(Neg) {
+        const Value& value = R[i.b];
+        if (value.is(VInt))
+            R[i.a] = Value::of_int(std::int64_t(0 - std::uint64_t(value.as_int())), heap);
+        else if (value.is(VFloat))
+            R[i.a] = Value::of_float(-value.as_float());
+        else
+            error(ci, pc - 1, sformat("Invalid unary operator - on %s",
+                Value::type_str(value.type())));
+        vm_dispatch();
+    }
+
+    vm_op(Jump) {
+        pc = code + i.target();
+        vm_dispatch();
+    }
+
+    vm_op(JumpIf) {
+        if (vm_truthy(R[i.a]))
+            pc = code + i.target();
+        vm_dispatch();
+    }
+
+    vm_op(JumpIfNot) {
+        if (!vm_truthy(R[i.a]))
+            pc = code + i.target();
+        vm_dispatch();
+    }
+
+    vm_op(JumpTable) {
+        const Dispatch& table = ci->proto->dispatch[i.b];
+        std::int64_t key;
+        std::uint64_t index;
+        if (dispatch_key(R[i.a], key)
+            && (index = std::uint64_t(key) - std::uint64_t(table.min)) < table.targets.size())
+            pc = code + table.targets[index];
+        else
+            pc = code + table.fallback;
+        vm_dispatch();
+    }
+
+    vm_op(JumpSearch) {
+        const Dispatch& table = ci->proto->dispatch[i.b];
+        std::int64_t key;
+        pc = code + table.fallback;
+        if (dispatch_key(R[i.a], key)) {
+            auto found = std::lower_bound(table.keys.begin(), table.keys.end(), key);
+            if (found != table.keys.end() && *found == key)
+                pc = code + table.targets[found - table.keys.begin()];
+        }
+        vm_dispatch();
+    }
+
+    vm_op(JumpHash) {
+        const Dispatch& table = ci->proto->dispatch[i.b];
+        pc = code + table.fallback;
+        if (R[i.a].is(VString)) {
+            const StrView& key = *R[i.a].as_string();
+            const std::size_t slot = table.slot(Interner::hash(key));
+            if (table.strings[slot] && *table.strings[slot] == key)
+                pc = code + table.targets[slot];
+        }
+        vm_dispatch();
+    }
+
+    // creating a function captures the current frame
+    vm_op(Closure) {
+        const Proto* proto = ci->proto->protos[i.b];
+        R[i.a] = Value::of_closure(heap.make<Closure>(proto->function, ci->frame, proto));
+        vm_dispatch();
+    }
+
+    vm_op(Call) {
+        const Value& callee = R[i.b];
+        if (!callee.is(VFunction))
+            error(ci, pc - 1, sformat("%s is not a function", Value::type_str(callee.type())));
+        const Closure* closure = callee.as_closure();
+        const Proto* proto = closure->proto;
+        const StrView& name = closure->function->name;
+        if (ci == last)
+            error(ci, pc - 1, sformat("Stack overflow calling %.*s", (int)name.size, name.data));
+        CallInfo* next = ci + 1;
+
+        // frames a closure may hold on to live on the heap
+        Value* regs;
+        if (proto->frame_captured) {
+            regs = static_cast<Value*>(heap.alloc(proto->registers * sizeof(Value), alignof(Value)));
+            next->stack_top = ci->stack_top;
+        } else {
+            regs = ci->stack_top;
+            if (proto->registers > std::size_t(stack.data() + stack.size() - regs))
+                error(ci, pc - 1, sformat("Stack overflow calling %.*s", (int)name.size, name.data));
+            next->stack_top = regs + proto->registers;
+        }
+        std::fill(regs, regs + proto->registers, Value());
+
+        // extra arguments are dropped
+        const std::size_t count = std::min<std::size_t>(i.c, proto->params.size());
+        for (std::size_t arg = 0; arg < count; arg++)
+            regs[proto->params[arg]] = R[i.b + 1 + arg];
+
+        ci->pc = pc;
+        ci->dest = i.a;
+        next->proto = proto;
+        next->regs = regs;
+        next->local = Frame(closure->env, regs);
+        next->frame = proto->frame_captured ? heap.make<Frame>(next->local) : &next->local;
+
+        ci = next;
+        R = regs;
+        K = proto->constants.data();
+        pc = code = proto->code.data();
+        vm_dispatch();
+    }
+
+    vm_op(Print) {
+        for (std::uint16_t arg = 0; arg < i.c; arg++) {
+            if (arg > 0) std::printf(" ");
+            R[i.b + arg].print();
+        }
+        std::printf("\n");
+        R[i.a] = Value();
+        vm_dispatch();
+    }
+
+    vm_op(Return) {
+        const Value value = R[i.a];
+        if (ci == calls.data())
+            return value;
+
+        ci--;
+        R = ci->regs;
+        K = ci->proto->constants.data();
+        code = ci->proto->code.data();
+        pc = ci->pc;
+        R[ci->dest] = value;
+        vm_dispatch();
+    }
+
+    vm_op(Fail) {
+        const StrView& message = *K[i.b].as_string();
+        error(ci, pc - 1, std::string(message.data, message.size));
+        vm_dispatch();
+    }
+
+#if !VMComputedGoto
+        default:
+            break;
+    }
+#endif
+
+    return Value();
+}
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Runs every tests/*.rath program under each engine and pass setup
+# and compares its output against the matching .out file.
+rath=${1:-./rath}
+dir=$(dirname "$0")
+failed=0
+
+for program in "$dir"/*.rath; do
+    expected="${program%.rath}.out"
+    for mode in "" "--vm" "--passes=fold"; do
+        if ! "$rath" run $mode "$program" 2>&1 | cmp -s - "$expected"; then
+            echo "FAIL $program ${mode:-tree}"
+            failed=$((failed + 1))
+        fi
+    done
+done
+
+if [ $failed -ne 0 ]; then
+    echo "$failed failed"
+    exit 1
+fi
+echo "all passed"